@@ -0,0 +1,162 @@
+/*
+ * addrtrace.c - Memory accesses of an allocator, for mdriver -L and -S
+ *
+ * The simulated cache works like the cache lab's csim: 2^s sets of E
+ * lines each, 2^b-byte blocks, LRU replacement, and a store that misses
+ * allocates its line like a load. The cache starts cold at every
+ * addrtrace_start. An access that spans several blocks (addrtrace_range
+ * traces up to ADDRTRACE_CHUNK bytes at a time) looks up each of them,
+ * where csim only looks up the block of its first byte; the two agree
+ * on the counts when blocks are at least ADDRTRACE_CHUNK bytes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "addrtrace.h"
+
+#define LACKEY_BUFSIZE (1 << 20)  /* stdio buffer of the lackey file */
+
+typedef struct {
+    int valid;
+    unsigned long long tag;
+    unsigned long long last_use;  /* when it was last looked up, for LRU */
+} line_t;
+
+/* The simulated cache, if any (-S) */
+static int set_bits = 0, num_lines = 0, block_bits = 0;
+static line_t *lines = NULL;      /* 2^set_bits sets of num_lines lines */
+static unsigned long long clock_now = 0;
+
+static int tracing = 0;
+static FILE *lackey = NULL;
+static addrcount_t counts;
+
+/*
+ * addrtrace_cache - Simulate a cache of 2^s sets of E lines of 2^b bytes
+ */
+int addrtrace_cache(int s, int E, int b)
+{
+    if (s < 0 || s > 20 || E < 1 || E > 1024 || b < 0 || b > 20)
+	return -1;
+    free(lines);
+    if ((lines = (line_t *)calloc((size_t)E << s, sizeof(line_t))) == NULL)
+	return -1;
+    set_bits = s;
+    num_lines = E;
+    block_bits = b;
+    return 0;
+}
+
+/*
+ * addrtrace_cached - Is a cache simulated?
+ */
+int addrtrace_cached(void)
+{
+    return lines != NULL;
+}
+
+/*
+ * addrtrace_start - Count (and simulate) accesses from now on, starting
+ *     from a cold cache, and write them to path if it is not NULL
+ */
+int addrtrace_start(char *path)
+{
+    if (path != NULL) {
+	if ((lackey = fopen(path, "w")) == NULL)
+	    return -1;
+	setvbuf(lackey, NULL, _IOFBF, LACKEY_BUFSIZE);
+    }
+    if (lines != NULL)
+	memset(lines, 0, ((size_t)num_lines << set_bits) * sizeof(line_t));
+    clock_now = 0;
+    memset(&counts, 0, sizeof(counts));
+    tracing = 1;
+    return 0;
+}
+
+/*
+ * addrtrace_stop - Stop tracing, returning the counts in *count
+ */
+void addrtrace_stop(addrcount_t *count)
+{
+    tracing = 0;
+    if (lackey != NULL) {
+	fclose(lackey);
+	lackey = NULL;
+    }
+    *count = counts;
+}
+
+/*
+ * lookup - Look up a block (address >> b) in the simulated cache,
+ *     loading it into the least recently used line of its set on a miss
+ */
+static void lookup(unsigned long long block)
+{
+    line_t *set = &lines[(block & ((1ULL << set_bits) - 1)) * num_lines];
+    line_t *victim = &set[0];
+    int i;
+
+    clock_now++;
+    for (i = 0; i < num_lines; i++) {
+	if (set[i].valid && set[i].tag == block) {
+	    set[i].last_use = clock_now;
+	    counts.hits++;
+	    return;
+	}
+	if (!set[i].valid || (victim->valid &&
+			      set[i].last_use < victim->last_use))
+	    victim = &set[i];
+    }
+    counts.misses++;
+    if (victim->valid)
+	counts.evictions++;
+    victim->valid = 1;
+    victim->tag = block;
+    victim->last_use = clock_now;
+}
+
+/*
+ * addrtrace_access - Record a load or store of size bytes at addr
+ */
+void addrtrace_access(void *addr, int size, int store)
+{
+    unsigned long long a = (unsigned long long)(size_t)addr;
+    unsigned long long block, last;
+
+    if (!tracing)
+	return;
+    if (store)
+	counts.stores++;
+    else
+	counts.loads++;
+    if (lackey != NULL)
+	fprintf(lackey, " %c %llx,%d\n", store ? 'S' : 'L', a, size);
+    if (lines != NULL) {
+	last = (a + (size > 0 ? size - 1 : 0)) >> block_bits;
+	for (block = a >> block_bits; block <= last; block++)
+	    lookup(block);
+    }
+}
+
+/*
+ * addrtrace_range - Record accesses to size bytes from addr, one per
+ *     ADDRTRACE_CHUNK-aligned piece, like a vectorized memset or memcpy
+ */
+void addrtrace_range(void *addr, size_t size, int store)
+{
+    char *p = (char *)addr, *end = (char *)addr + size;
+    char *next;
+
+    if (!tracing)
+	return;
+    while (p < end) {
+	next = (char *)(((size_t)p + ADDRTRACE_CHUNK) &
+			~(size_t)(ADDRTRACE_CHUNK - 1));
+	if (next > end)
+	    next = end;
+	addrtrace_access(p, next - p, store);
+	p = next;
+    }
+}
@@ -0,0 +1,43 @@
+/*
+ * addrtrace.h - Memory accesses of an allocator, for mdriver -L and -S
+ *
+ * The Makefile builds mm.c (and each policy variant) once more with
+ * MM_ADDR_TRACE defined, which makes every header, footer, free-list
+ * link and span word that mm.c reads or writes, and the payload bytes
+ * it copies in realloc, call addrtrace_access. mdriver may add the
+ * payload accesses of the application. While tracing is on, each
+ * access is written as a valgrind lackey line (" L addr,size" or
+ * " S addr,size"), the format that the cache lab's csim reads, and/or
+ * looked up in a simulated set-associative LRU cache.
+ */
+#ifndef __ADDRTRACE_H_
+#define __ADDRTRACE_H_
+
+#include <stddef.h>
+
+#define ADDRTRACE_CHUNK 64  /* largest access of addrtrace_range */
+
+/* What a traced replay did */
+typedef struct {
+    double loads;        /* accesses traced */
+    double stores;
+    double hits;         /* lookups in the simulated cache (if any)... */
+    double misses;       /* ... that missed... */
+    double evictions;    /* ... and that evicted a valid line */
+} addrcount_t;
+
+/* Simulate a cache of 2^s sets of E lines of 2^b bytes; -1 if invalid */
+int addrtrace_cache(int s, int E, int b);
+int addrtrace_cached(void);
+
+/* Trace accesses, writing them to path if not NULL; -1 if it can't */
+int addrtrace_start(char *path);
+void addrtrace_stop(addrcount_t *count);
+
+/* Record an access of size bytes at addr, if tracing */
+void addrtrace_access(void *addr, int size, int store);
+
+/* Record accesses to each ADDRTRACE_CHUNK-byte piece of a range */
+void addrtrace_range(void *addr, size_t size, int store);
+
+#endif /* __ADDRTRACE_H_ */
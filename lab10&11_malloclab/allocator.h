@@ -0,0 +1,63 @@
+/*
+ * allocator.h - Allocator backends that mdriver can evaluate
+ *
+ * Each backend is a table of functions. mm.c and its compile-time
+ * policy variants (mm_variants.c) allocate from the simulated heap of
+ * memlib.c, so mdriver can check that their blocks lie in the heap and
+ * measure their utilization. The other backends (allocators.c) are
+ * libc malloc, a bump-pointer baseline on the memlib heap, and any
+ * optional allocator library that can be loaded at run time. Before
+ * reset, mdriver frees the blocks that a backend without ALLOC_HEAP
+ * still holds; the memlib heap is simply reset.
+ */
+#ifndef __ALLOCATOR_H_
+#define __ALLOCATOR_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* mm.h (for mm_stats_t) must be included first */
+
+/* Flags of a backend */
+#define ALLOC_HEAP 0x1   /* allocates from the memlib heap */
+
+typedef struct {
+    char *name;                               /* e.g. "best-addr", "libc" */
+    int flags;                                /* ALLOC_* */
+    int (*init)(void);
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    size_t (*usable_size)(void *ptr);         /* NULL if not known */
+    void (*reset)(void);                      /* start over, before init */
+    void (*get_stats)(mm_stats_t *stats);
+    void (*set_threaded)(int enable);
+    int (*dump_layout)(FILE *fp);             /* NULL if not known */
+
+    /* The rest of the API that traces may call (see trace.h). mdriver
+     * replaces a NULL calloc by malloc and memset, NULL free_sized and
+     * batch calls by free and one call per block; with a NULL memalign,
+     * traces that align blocks fail. */
+    void *(*calloc)(size_t nmemb, size_t size);
+    void *(*memalign)(size_t alignment, size_t size);
+    void (*free_sized)(void *ptr, size_t size);
+    int (*malloc_batch)(size_t size, int n, void **ptrs); /* blocks done */
+    void (*free_batch)(void **ptrs, int n);
+} allocator_t;
+
+/*
+ * The Makefile builds mm.c once per policy variant with its functions
+ * renamed to <prefix>_init, ...; the first entry is the plain mm.o.
+ */
+extern allocator_t mm_variants[];  /* terminated by a NULL name */
+
+/*
+ * The same builds of mm.c with MM_ADDR_TRACE defined, which report the
+ * addresses they touch to addrtrace.c; entry i traces mm_variants[i]
+ */
+extern allocator_t mm_traced_variants[];
+
+allocator_t **allocators_list(void);
+allocator_t *allocators_find(char *name);
+
+#endif /* __ALLOCATOR_H_ */
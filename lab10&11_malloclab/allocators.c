@@ -0,0 +1,265 @@
+/*
+ * allocators.c - The allocator backends of mdriver other than mm.c
+ *
+ * libc malloc; a bump-pointer allocator on the memlib heap, which never
+ * reuses a block and so bounds the throughput (and utilization) that
+ * any real allocator can reach; and the optional allocator libraries of
+ * optional[] that dlopen finds on this machine. allocators_list puts
+ * them after the policy variants of mm.c.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+#include "allocator.h"
+
+#define BUMP_HEADER ALIGNMENT  /* bytes before a bump payload, holding its size */
+#define NUM_OPTIONAL (sizeof(optional) / sizeof(optional[0]))
+
+#define NUM_SYMS 7        /* functions looked up in an optional library... */
+#define REQUIRED_SYMS 4   /* ... of which the first ones must be there */
+
+/* Optional allocator libraries: library name, then the names of their
+ * malloc, free, realloc, usable size, calloc, memalign (alignment
+ * first) and sized free functions */
+static struct {
+    char *name;
+    char *lib;
+    char *syms[NUM_SYMS];
+} optional[] = {
+    {"jemalloc", "libjemalloc.so.2",
+     {"malloc", "free", "realloc", "malloc_usable_size", "calloc",
+      "aligned_alloc", "free_sized"}},
+    {"tcmalloc", "libtcmalloc_minimal.so.4",
+     {"tc_malloc", "tc_free", "tc_realloc", "tc_malloc_size", "tc_calloc",
+      "tc_memalign", "tc_free_sized"}},
+    {"mimalloc", "libmimalloc.so.2",
+     {"mi_malloc", "mi_free", "mi_realloc", "mi_usable_size", "mi_calloc",
+      "mi_aligned_alloc", "mi_free_size"}},
+};
+
+/* Backends with nothing to set up, reset or lock (libc is thread safe) */
+static int no_init(void) { return 0; }
+static void no_reset(void) { }
+static void no_threaded(int enable) { }
+
+/*
+ * no_stats - Backends other than mm.c count no events
+ */
+static void no_stats(mm_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+/*
+ * libc_memalign - posix_memalign, which takes no alignment below that
+ *    of a pointer
+ */
+static void *libc_memalign(size_t alignment, size_t size)
+{
+    void *p;
+
+    if (alignment < sizeof(void *))
+	alignment = sizeof(void *);
+    return (posix_memalign(&p, alignment, size) == 0) ? p : NULL;
+}
+
+static allocator_t libc_allocator = {
+    "libc", 0, no_init, malloc, free, realloc,
+#ifdef __GLIBC__
+    malloc_usable_size,
+#else
+    NULL,
+#endif
+    no_reset, no_stats, no_threaded, NULL,
+    calloc, libc_memalign, NULL, NULL, NULL
+};
+
+/*
+ * The bump allocator. Each block is the BUMP_HEADER bytes holding its
+ * (aligned) size, then the payload, carved off the top of the heap.
+ */
+static int bump_threaded = 0;
+static pthread_mutex_t bump_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * bump_malloc - Extend the heap by one block
+ */
+static void *bump_malloc(size_t size)
+{
+    char *p;
+
+    size = (size + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+    if (size > (size_t)INTPTR_MAX - BUMP_HEADER)
+	return NULL;
+    if (bump_threaded)
+	pthread_mutex_lock(&bump_lock);
+    p = mem_sbrk(size + BUMP_HEADER);
+    if (bump_threaded)
+	pthread_mutex_unlock(&bump_lock);
+    if (p == (char *)-1)
+	return NULL;
+    *(size_t *)p = size;
+    return p + BUMP_HEADER;
+}
+
+/*
+ * bump_memalign - Extend the heap by padding, then a block whose 
+ *    payload is aligned
+ */
+static void *bump_memalign(size_t alignment, size_t size)
+{
+    char *p;
+    size_t pad;
+
+    if (alignment <= ALIGNMENT)
+	return bump_malloc(size);
+    size = (size + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+    if (size > (size_t)INTPTR_MAX - BUMP_HEADER - alignment)
+	return NULL;
+    if (bump_threaded)
+	pthread_mutex_lock(&bump_lock);
+    p = (char *)mem_heap_hi() + 1 + BUMP_HEADER;
+    pad = -(size_t)p & (alignment - 1);
+    p = mem_sbrk(pad + BUMP_HEADER + size);
+    if (bump_threaded)
+	pthread_mutex_unlock(&bump_lock);
+    if (p == (char *)-1)
+	return NULL;
+    p += pad;
+    *(size_t *)p = size;
+    return p + BUMP_HEADER;
+}
+
+/*
+ * bump_free - Blocks are never reused
+ */
+static void bump_free(void *ptr)
+{
+}
+
+/*
+ * bump_usable_size - The aligned size kept in front of the payload
+ */
+static size_t bump_usable_size(void *ptr)
+{
+    return *(size_t *)((char *)ptr - BUMP_HEADER);
+}
+
+/*
+ * bump_realloc - Copy the payload to a new block
+ */
+static void *bump_realloc(void *ptr, size_t size)
+{
+    void *newptr;
+    size_t oldsize;
+
+    if ((newptr = bump_malloc(size)) == NULL || ptr == NULL)
+	return newptr;
+    oldsize = bump_usable_size(ptr);
+    memcpy(newptr, ptr, (oldsize < size) ? oldsize : size);
+    return newptr;
+}
+
+/*
+ * bump_set_threaded - Serialize mem_sbrk while threads share the heap
+ */
+static void bump_set_threaded(int enable)
+{
+    bump_threaded = enable;
+}
+
+static allocator_t bump_allocator = {
+    "bump", ALLOC_HEAP, no_init, bump_malloc, bump_free, bump_realloc,
+    bump_usable_size, mem_reset_brk, no_stats, bump_set_threaded, NULL,
+    NULL, bump_memalign, NULL, NULL, NULL
+};
+
+/*
+ * load_optional - Fill in *a with the functions of optional library i.
+ *    Returns 0 if the library or one of its functions is missing.
+ */
+static int load_optional(int i, allocator_t *a)
+{
+    void *handle, *fns[NUM_SYMS];
+    int j;
+
+    if ((handle = dlopen(optional[i].lib, RTLD_NOW | RTLD_LOCAL)) == NULL)
+	return 0;
+    for (j = 0; j < NUM_SYMS; j++)
+	if ((fns[j] = dlsym(handle, optional[i].syms[j])) == NULL &&
+	    j < REQUIRED_SYMS) {
+	    dlclose(handle);
+	    return 0;
+	}
+    a->name = optional[i].name;
+    a->flags = 0;
+    a->init = no_init;
+    a->malloc = (void *(*)(size_t))fns[0];
+    a->free = (void (*)(void *))fns[1];
+    a->realloc = (void *(*)(void *, size_t))fns[2];
+    a->usable_size = (size_t (*)(void *))fns[3];
+    a->reset = no_reset;
+    a->get_stats = no_stats;
+    a->set_threaded = no_threaded;
+    a->dump_layout = NULL;
+    a->calloc = (void *(*)(size_t, size_t))fns[4];
+    a->memalign = (void *(*)(size_t, size_t))fns[5];
+    a->free_sized = (void (*)(void *, size_t))fns[6];
+    a->malloc_batch = NULL;
+    a->free_batch = NULL;
+    return 1;
+}
+
+/*
+ * allocators_list - Return the NULL-terminated list of every backend:
+ *    the variants of mm.c, libc, bump and the optional libraries found
+ */
+allocator_t **allocators_list(void)
+{
+    static allocator_t **list = NULL;
+    static allocator_t loaded[NUM_OPTIONAL];
+    int i, n, num_variants = 0;
+
+    if (list != NULL)
+	return list;
+    while (mm_variants[num_variants].name != NULL)
+	num_variants++;
+    if ((list = (allocator_t **)calloc(num_variants + 2 + NUM_OPTIONAL + 1,
+				       sizeof(allocator_t *))) == NULL) {
+	fprintf(stderr, "calloc failed in allocators_list\n");
+	exit(1);
+    }
+    n = 0;
+    for (i = 0; i < num_variants; i++)
+	list[n++] = &mm_variants[i];
+    list[n++] = &libc_allocator;
+    list[n++] = &bump_allocator;
+    for (i = 0; i < NUM_OPTIONAL; i++)
+	if (load_optional(i, &loaded[i]))
+	    list[n++] = &loaded[i];
+    list[n] = NULL;
+    return list;
+}
+
+/*
+ * allocators_find - Return the backend called name, or NULL
+ */
+allocator_t *allocators_find(char *name)
+{
+    allocator_t **a;
+
+    for (a = allocators_list(); *a != NULL; a++)
+	if (strcmp((*a)->name, name) == 0)
+	    return *a;
+    return NULL;
+}
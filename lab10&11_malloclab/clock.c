@@ -1,5 +1,5 @@
 /* 
- * clock.c - Routines for using the cycle counters on x86, 
+ * clock.c - Routines for using the cycle counters on x86, x86-64,
  *           Alpha, and Sparc boxes.
  * 
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
@@ -10,13 +10,14 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/times.h>
+#include <time.h>
 #include "clock.h"
 
 
 /******************************************************* 
  * Machine dependent functions 
  *
- * Note: the constants __i386__ and  __alpha
+ * Note: the constants __i386__, __x86_64__ and __alpha
  * are set by GCC when it calls the C preprocessor
  * You can verify this for yourself using gcc -v.
  *******************************************************/
@@ -71,6 +72,40 @@ double get_counter()
 }
 /* $end x86cyclecounter */
 
+#elif defined(__x86_64__)
+/*******************************************************
+ * x86-64 versions of start_counter() and get_counter()
+ *******************************************************/
+
+/* 
+ * On out-of-order cores rdtsc can be executed before earlier
+ * instructions finish or after later ones start. start_counter fences
+ * before reading the counter, so that the timed code cannot start
+ * before the read; get_counter uses rdtscp, which waits for the timed
+ * code to finish, and fences after it, so that later code cannot
+ * start before the read.
+ */
+static unsigned long long cyc_start = 0;
+
+/* Record the current value of the cycle counter. */
+void start_counter()
+{
+    unsigned hi, lo;
+
+    asm volatile("lfence; rdtsc" : "=a" (lo), "=d" (hi) : : "memory");
+    cyc_start = ((unsigned long long)hi << 32) | lo;
+}
+
+/* Return the number of cycles since the last call to start_counter. */
+double get_counter()
+{
+    unsigned hi, lo, aux;
+
+    asm volatile("rdtscp; lfence" : "=a" (lo), "=d" (hi), "=c" (aux) 
+		 : : "memory");
+    return (double)((((unsigned long long)hi << 32) | lo) - cyc_start);
+}
+
 #elif defined(__alpha)
 
 /****************************************************
@@ -179,26 +214,64 @@ double ovhd()
     return result;
 }
 
+/* Seconds on the raw monotonic clock, which NTP does not slew */
+static double raw_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
 /* $begin mhz */
 /* Estimate the clock rate by measuring the cycles that elapse */ 
 /* while sleeping for sleeptime seconds */
 double mhz_full(int verbose, int sleeptime)
 {
-    double rate;
+    double rate, start;
 
+    start = raw_secs();
     start_counter();
     sleep(sleeptime);
-    rate = get_counter() / (1e6*sleeptime);
+    /* sleep may oversleep, so divide by the time that really passed */
+    rate = get_counter() / (1e6*(raw_secs() - start));
     if (verbose) 
 	printf("Processor clock rate ~= %.1f MHz\n", rate);
     return rate;
 }
 /* $end mhz */
 
-/* Version using a default sleeptime */
+#define CALIB_RUNS 5       /* calibration windows... */
+#define CALIB_SECS 0.02    /* ... of this many seconds each */
+
+/* 
+ * Calibrate the counter against the raw monotonic clock by spinning
+ * for CALIB_RUNS short windows and taking the median rate, which
+ * discards windows that a preemption or frequency change disturbed.
+ * On x86 the counter runs at the constant TSC rate, not the current
+ * core clock, so this is the rate that converts counts to seconds.
+ */
 double mhz(int verbose)
 {
-    return mhz_full(verbose, 2);
+    double rates[CALIB_RUNS], start, end, rate;
+    int i, j;
+
+    for (i = 0; i < CALIB_RUNS; i++) {
+	start = raw_secs();
+	start_counter();
+	while ((end = raw_secs()) - start < CALIB_SECS)
+	    ;
+	rate = get_counter() / (1e6*(end - start));
+
+	/* insert rate into the sorted rates[0..i] */
+	for (j = i; j > 0 && rates[j-1] > rate; j--)
+	    rates[j] = rates[j-1];
+	rates[j] = rate;
+    }
+    rate = rates[CALIB_RUNS/2];
+    if (verbose) 
+	printf("Processor clock rate ~= %.1f MHz\n", rate);
+    return rate;
 }
 
 /** Special counters that compensate for timer interrupt overhead */
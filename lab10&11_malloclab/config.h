@@ -68,20 +68,38 @@
 #define UTIL_WEIGHT .60
 
 /* 
- * Alignment requirement in bytes (either 4 or 8) 
+ * Alignment requirement in bytes (8, or 16 on 64-bit hosts, where
+ * mm.c's headers and footers are 8 bytes each)
  */
+#ifdef __LP64__
+#define ALIGNMENT 16
+#else
 #define ALIGNMENT 8  
+#endif
 
 /* 
- * Maximum heap size in bytes 
+ * Maximum heap size in bytes. memlib only reserves this much address
+ * space; pages are committed as the heap first touches them, so a
+ * 64-bit host can run heaps of tens of GB without paying for them up
+ * front.
  */
+#ifdef __LP64__
+#define MAX_HEAP ((size_t)64 << 30)  /* 64 GB */
+#else
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
+#endif
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
-#define USE_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
+#if defined(__i386__) || defined(__x86_64__)
+#define USE_FCYC   1   /* cycle counter w/K-best scheme (x86 & Alpha only) */
+#define USE_CLOCK  0   /* clock_gettime(CLOCK_MONOTONIC_RAW) (POSIX) */
+#else
+#define USE_FCYC   0
+#define USE_CLOCK  1
+#endif
 #define USE_ITIMER 0   /* interval timer (any Unix box) */
-#define USE_GETTOD 1   /* gettimeofday (any Unix box) */
+#define USE_GETTOD 0   /* gettimeofday (any Unix box) */
 
 #endif /* __CONFIG_H */
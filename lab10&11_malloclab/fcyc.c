@@ -129,6 +129,7 @@ static void clear()
 double fcyc(test_funct f, void *argp)
 {
     double result;
+    int tries = 0;   /* samples taken, including rejected ones */
     init_sampler();
     if (compensate) {
 	do {
@@ -138,8 +139,9 @@ double fcyc(test_funct f, void *argp)
 	    start_comp_counter();
 	    f(argp);
 	    cyc = get_comp_counter();
-	    add_sample(cyc);
-	} while (!has_converged() && samplecount < maxsamples);
+	    if (cyc > 0)
+		add_sample(cyc);
+	} while (!has_converged() && ++tries < maxsamples);
     } else {
 	do {
 	    double cyc;
@@ -148,8 +150,9 @@ double fcyc(test_funct f, void *argp)
 	    start_counter();
 	    f(argp);
 	    cyc = get_counter();
-	    add_sample(cyc);
-	} while (!has_converged() && samplecount < maxsamples);
+	    if (cyc > 0)
+		add_sample(cyc);
+	} while (!has_converged() && ++tries < maxsamples);
     }
 #ifdef DEBUG
     {
@@ -159,7 +162,9 @@ double fcyc(test_funct f, void *argp)
 	    printf("%.0f%s", values[i], i==kbest-1 ? "]\n" : ", ");
     }
 #endif
-    result = values[0];
+    /* A compensated count can go negative when the tick correction
+       overshoots; such samples are dropped rather than ranked first */
+    result = samplecount > 0 ? values[0] : 0.0;
 #if !KEEP_VALS
     free(values); 
     values = NULL;
@@ -1,22 +1,79 @@
 /****************************
  * High-level timing wrappers
  ****************************/
+#define _GNU_SOURCE  /* sched_setaffinity */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
 #include "fsecs.h"
 #include "fcyc.h"
 #include "clock.h"
 #include "ftimer.h"
+#include "perfctr.h"
 #include "config.h"
 
+#define CACHE_LINE 64        /* bytes read per line when flushing the cache */
+#define DEF_FLUSH (1<<19)    /* flush size if the LLC size is unknown */
+
 static double Mhz;  /* estimated CPU clock frequency */
 
+/* Timing controls, set before init_fsecs (mdriver -K, -c, -W, -C) */
+static int kbest = 3;        /* K of the K-best scheme... */
+static double epsilon = 0.01;/* ... whose K samples are within epsilon */
+static int maxsamples = 20;  /* samples to take before giving up on that */
+static int fixed = 0;        /* if set, take exactly kbest samples */
+static int flush_bytes = -1; /* bytes to read before each run; -1: the LLC */
+static int warmup = 0;       /* untimed runs of f before it is timed */
+static int cpus[CPU_SETSIZE];/* CPUs to run on (-C) ... */
+static int num_cpus = 0;     /* ... and how many there are; 0: any */
+
 extern int verbose; /* -v option in mdriver.c */
 
+/*
+ * llc_size - Size in bytes of the last-level cache, read from sysfs 
+ *     (or sysconf), or 0 if unknown
+ */
+static long llc_size(void)
+{
+    char path[128], unit;
+    FILE *fp;
+    int i, level, top = 0;
+    long size, llc = 0;
+
+    for (i = 0; ; i++) {
+	sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/level", i);
+	if ((fp = fopen(path, "r")) == NULL)
+	    break;
+	if (fscanf(fp, "%d", &level) != 1)
+	    level = 0;
+	fclose(fp);
+	sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/size", i);
+	if ((fp = fopen(path, "r")) == NULL)
+	    break;
+	if (fscanf(fp, "%ld%c", &size, &unit) == 2 && level >= top) {
+	    top = level;
+	    llc = size * ((unit == 'K') ? 1024 : (unit == 'M') ? 1<<20 : 1);
+	}
+	fclose(fp);
+    }
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    if (llc <= 0)
+	llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (llc <= 0)
+	llc = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+    return (llc > 0) ? llc : 0;
+}
+
 /*
  * init_fsecs - initialize the timing package
  */
 void init_fsecs(void)
 {
+    long llc = llc_size();
+
     Mhz = 0; /* keep gcc -Wall happy */
 
 #if USE_FCYC
@@ -24,18 +81,34 @@ void init_fsecs(void)
 	printf("Measuring performance with a cycle counter.\n");
 
     /* set key parameters for the fcyc package */
-    set_fcyc_maxsamples(20); 
-    set_fcyc_clear_cache(1);
-    set_fcyc_compensate(1);
-    set_fcyc_epsilon(0.01);
-    set_fcyc_k(3);
+    if (flush_bytes < 0)
+	flush_bytes = llc ? (int)llc : DEF_FLUSH;
+    set_fcyc_maxsamples(fixed ? kbest : maxsamples); 
+    set_fcyc_clear_cache(flush_bytes > 0);
+    if (flush_bytes > 0) {
+	set_fcyc_cache_size(flush_bytes);
+	set_fcyc_cache_block(CACHE_LINE);
+    }
+    set_fcyc_compensate(0); /* tick correction overshoots on a TSC */
+    set_fcyc_epsilon(epsilon);
+    set_fcyc_k(kbest);
     Mhz = mhz(verbose > 0);
+    if (verbose && fixed)
+	printf("K-best: fastest of exactly %d samples; "
+	       "flushing %d KB of cache\n", kbest, flush_bytes / 1024);
+    else if (verbose)
+	printf("K-best: K=%d within %g, at most %d samples; "
+	       "flushing %d KB of cache\n", 
+	       kbest, epsilon, maxsamples, flush_bytes / 1024);
 #elif USE_ITIMER
     if (verbose)
 	printf("Measuring performance with the interval timer.\n");
 #elif USE_GETTOD
     if (verbose)
 	printf("Measuring performance with gettimeofday().\n");
+#elif USE_CLOCK
+    if (verbose)
+	printf("Measuring performance with clock_gettime().\n");
 #endif
 }
 
@@ -44,6 +117,10 @@ void init_fsecs(void)
  */
 double fsecs(fsecs_test_funct f, void *argp) 
 {
+    int i;
+
+    for (i = 0; i < warmup; i++)
+	f(argp);
 #if USE_FCYC
     double cycles = fcyc(f, argp);
     return cycles/(Mhz*1e6);
@@ -51,7 +128,130 @@ double fsecs(fsecs_test_funct f, void *argp)
     return ftimer_itimer(f, argp, 10);
 #elif USE_GETTOD
     return ftimer_gettod(f, argp, 10);
+#elif USE_CLOCK
+    return ftimer_clock(f, argp, 10);
 #endif 
 }
 
 
+
+/*
+ * fsecs_count - Run f once more, after it has been timed, and store the
+ *     hardware events it caused in *counts (see perfctr.h). Returns 0 
+ *     if no counter could be opened, in which case every count is -1.
+ */
+int fsecs_count(fsecs_test_funct f, void *argp, perfctr_t *counts)
+{
+    static int opened = -1;  /* number of counters, once opened */
+    int i;
+
+    if (opened < 0)
+	opened = perfctr_init();
+    if (opened == 0) {
+	for (i = 0; i < PERFCTR_EVENTS; i++)
+	    counts->counts[i] = -1;
+	return 0;
+    }
+    perfctr_start();
+    f(argp);
+    perfctr_stop(counts);
+    return 1;
+}
+
+/*
+ * set_fsecs_kbest - Take the fastest of at least k runs, once the k 
+ *     fastest are within epsilon of each other, or after maxsamples
+ *     runs. Cycle counter only (USE_FCYC).
+ */
+void set_fsecs_kbest(int k, double epsilon_arg, int maxsamples_arg)
+{
+    kbest = k;
+    epsilon = epsilon_arg;
+    maxsamples = maxsamples_arg;
+}
+
+/*
+ * set_fsecs_flush - Read a buffer of bytes before each timed run to 
+ *     flush the caches (0: don't flush). Defaults to the size of the 
+ *     last-level cache. Cycle counter only (USE_FCYC).
+ */
+void set_fsecs_flush(int bytes)
+{
+    flush_bytes = bytes;
+}
+
+/*
+ * set_fsecs_fixed - If enable is set, time f exactly k times (the k of
+ *     set_fsecs_kbest) instead of until the k fastest runs agree, so
+ *     that every run of mdriver does the same work. Cycle counter only.
+ */
+void set_fsecs_fixed(int enable)
+{
+    fixed = enable;
+}
+
+/*
+ * set_fsecs_warmup - Run f n times, untimed, before timing it
+ */
+void set_fsecs_warmup(int n)
+{
+    warmup = n;
+}
+
+/*
+ * set_fsecs_cpus - Run the calling process on the CPUs of list, e.g.
+ *     "2" or "0,2,4-7". Returns 0, or -1 if list is malformed or names 
+ *     a CPU that we may not run on.
+ */
+int set_fsecs_cpus(char *list)
+{
+    cpu_set_t set;
+    char *p = list, *end;
+    long lo, hi;
+
+    CPU_ZERO(&set);
+    num_cpus = 0;
+    while (*p != '\0') {
+	lo = hi = strtol(p, &end, 10);
+	if (end == p || lo < 0)
+	    return -1;
+	if (*end == '-') {
+	    p = end + 1;
+	    hi = strtol(p, &end, 10);
+	    if (end == p || hi < lo)
+		return -1;
+	}
+	for (; lo <= hi; lo++) {
+	    if (lo >= CPU_SETSIZE || num_cpus == CPU_SETSIZE)
+		return -1;
+	    CPU_SET(lo, &set);
+	    cpus[num_cpus++] = lo;
+	}
+	if (*end == ',')
+	    end++;
+	else if (*end != '\0')
+	    return -1;
+	p = end;
+    }
+    if (num_cpus == 0 || sched_setaffinity(0, sizeof(set), &set) < 0) {
+	num_cpus = 0;
+	return -1;
+    }
+    return 0;
+}
+
+/*
+ * fsecs_pin_job - Move the calling process to the job-th CPU of the 
+ *     list given to set_fsecs_cpus (if any), so that concurrent jobs 
+ *     (mdriver -j) each keep a CPU of their own
+ */
+void fsecs_pin_job(int job)
+{
+    cpu_set_t set;
+
+    if (num_cpus == 0)
+	return;
+    CPU_ZERO(&set);
+    CPU_SET(cpus[job % num_cpus], &set);
+    sched_setaffinity(0, sizeof(set), &set);
+}
@@ -1,4 +1,15 @@
+#include "perfctr.h"
+
 typedef void (*fsecs_test_funct)(void *);
 
 void init_fsecs(void);
 double fsecs(fsecs_test_funct f, void *argp);
+int fsecs_count(fsecs_test_funct f, void *argp, perfctr_t *counts);
+
+/* Timing controls; call before init_fsecs */
+void set_fsecs_kbest(int k, double epsilon, int maxsamples);
+void set_fsecs_flush(int bytes);
+void set_fsecs_warmup(int n);
+void set_fsecs_fixed(int enable);
+int set_fsecs_cpus(char *list);
+void fsecs_pin_job(int job);
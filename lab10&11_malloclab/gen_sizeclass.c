@@ -0,0 +1,279 @@
+/*
+ * gen_sizeclass.c - Derive mm.c's size classes from allocation traces
+ *
+ * Reads one or more .rep tracefiles, builds a histogram of the block
+ * sizes mm.c would request for every alloc/realloc (payload rounded up
+ * to ALIGNMENT plus header and footer), and partitions the sizes up to
+ * a lookup limit into classes that minimize the total internal
+ * fragmentation
+ *
+ *     sum over requests of (class bound - block size)
+ *
+ * with a dynamic program over the sorted distinct sizes. Larger blocks,
+ * up to the largest size_t, fall into one final class. The result is
+ * written as a C header with the class bounds (size_t, like mm.c's block
+ * sizes) and a size-to-class lookup array indexed by block size /
+ * ALIGNMENT (16 on LP64), so that mm.c maps a block size to its class
+ * with one table load.
+ *
+ * Usage: gen_sizeclass [-n <classes>] [-m <max>] [-o <file>] <trace>...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "config.h"
+#include "trace.h"
+
+#define MAXLINE 1024
+#define DEF_CLASSES 16        /* classes incl. the final large class */
+#define DEF_LOOKUP_MAX 4096   /* largest block size in the lookup array */
+#define OVERHEAD (2 * sizeof(size_t)) /* header + footer bytes added by mm.c */
+
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(ALIGNMENT-1))
+
+static double *counts;        /* counts[s/ALIGNMENT]: requests of size s */
+static unsigned lookup_max = DEF_LOOKUP_MAX;
+
+static void usage(void);
+
+/*
+ * read_sizes - Add the block sizes requested by one tracefile to counts[]
+ */
+static void read_sizes(char *path, double *large)
+{
+    FILE *fp;
+    char line[MAXLINE];
+    int hdr[4], parsed;
+    traceop_t op;
+    unsigned long long block_size;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+        fprintf(stderr, "Could not open %s\n", path);
+        exit(1);
+    }
+    if (fscanf(fp, "%d %d %d %d", &hdr[0], &hdr[1], &hdr[2], &hdr[3]) != 4) {
+        fprintf(stderr, "Bad trace header in %s\n", path);
+        exit(1);
+    }
+    while (fgets(line, MAXLINE, fp) != NULL) {
+        if ((parsed = trace_parse_op(line, &op)) == 0)
+            continue;
+        if (parsed < 0) {
+            fprintf(stderr, "Bad request in %s\n", path);
+            exit(1);
+        }
+        if (op.type == FREE || op.type == SIZED_FREE || op.type == BATCH_FREE)
+            continue;
+        block_size = ALIGN(OP_PAYLOAD(&op)) + OVERHEAD;
+        if (block_size <= lookup_max)
+            counts[block_size / ALIGNMENT] += OP_IDS(&op);
+        else
+            *large += OP_IDS(&op);
+    }
+    fclose(fp);
+}
+
+/*
+ * partition - Split the m distinct sizes[] (with weights w[]) into at
+ *     most k classes minimizing the fragmentation, and store the bound
+ *     (largest size) of each class in bounds[]. Returns the number of
+ *     classes used.
+ */
+static int partition(unsigned *sizes, double *w, int m, int k, unsigned *bounds)
+{
+    double *cw, *cs;       /* prefix sums of w[i] and w[i]*sizes[i] */
+    double *cost, *prev;   /* cost[j]: best cost of sizes[0..j] so far */
+    int *cut;              /* cut[c*m+j]: first size of the last class */
+    int c, i, j, used;
+
+    if (m == 0)
+        return 0;
+    if (k > m)
+        k = m;
+
+    cw = calloc(m + 1, sizeof(double));
+    cs = calloc(m + 1, sizeof(double));
+    cost = calloc(m, sizeof(double));
+    prev = calloc(m, sizeof(double));
+    cut = calloc((size_t)k * m, sizeof(int));
+    if (!cw || !cs || !cost || !prev || !cut) {
+        fprintf(stderr, "partition: calloc failed\n");
+        exit(1);
+    }
+    for (i = 0; i < m; i++) {
+        cw[i+1] = cw[i] + w[i];
+        cs[i+1] = cs[i] + w[i] * sizes[i];
+    }
+
+/* Fragmentation of one class holding sizes[i..j] with bound sizes[j] */
+#define CLASS_COST(i, j) \
+    (sizes[j] * (cw[(j)+1] - cw[i]) - (cs[(j)+1] - cs[i]))
+
+    for (j = 0; j < m; j++) {
+        prev[j] = CLASS_COST(0, j);
+        cut[j] = 0;
+    }
+    for (c = 1; c < k; c++) {
+        for (j = 0; j < m; j++) {
+            cost[j] = prev[j];
+            cut[c*m + j] = cut[(c-1)*m + j];
+            for (i = 1; i <= j; i++) {
+                double t = prev[i-1] + CLASS_COST(i, j);
+                if (t < cost[j]) {
+                    cost[j] = t;
+                    cut[c*m + j] = i;
+                }
+            }
+        }
+        memcpy(prev, cost, m * sizeof(double));
+    }
+
+    /* Walk the cuts back from the largest size */
+    used = 0;
+    for (c = k - 1, j = m - 1; j >= 0; c--) {
+        bounds[used++] = sizes[j];
+        j = cut[c*m + j] - 1;
+    }
+    /* Bounds were collected from the top down */
+    for (i = 0; i < used / 2; i++) {
+        unsigned t = bounds[i];
+        bounds[i] = bounds[used-1-i];
+        bounds[used-1-i] = t;
+    }
+#undef CLASS_COST
+
+    free(cw); free(cs); free(cost); free(prev); free(cut);
+    return used;
+}
+
+/*
+ * write_header - Emit the class table and the size-to-class lookup array
+ */
+static void write_header(FILE *out, unsigned *bounds, int nsmall,
+                         int argc, char **argv)
+{
+    unsigned s;
+    int i, c, nclasses = nsmall + 1;
+
+    fprintf(out, "/*\n");
+    fprintf(out, " * sizeclass.h - Size classes of mm.c, generated by gen_sizeclass from\n");
+    for (i = 0; i < argc; i++)
+        fprintf(out, " *     %s\n", argv[i]);
+    fprintf(out, " *\n");
+    fprintf(out, " * Do not edit; run \"make sizeclasses\" to regenerate.\n");
+    fprintf(out, " */\n");
+    fprintf(out, "#ifndef __SIZECLASS_H_\n#define __SIZECLASS_H_\n\n");
+    fprintf(out, "#include <stddef.h>\n#include <stdint.h>\n\n");
+    fprintf(out, "#define NUM_SIZE_CLASSES %d\n", nclasses);
+    fprintf(out, "#define SIZE_CLASS_LOOKUP_MAX %u\n\n", lookup_max);
+
+    fprintf(out, "/* Largest block size (bytes, incl. header and footer) of each class */\n");
+    fprintf(out, "static const size_t size_class_bounds[NUM_SIZE_CLASSES] = {");
+    for (i = 0; i < nsmall; i++)
+        fprintf(out, "%s%u,", (i % 8 == 0) ? "\n    " : " ", bounds[i]);
+    fprintf(out, "%sSIZE_MAX\n};\n\n", (nsmall % 8 == 0) ? "\n    " : " ");
+
+    fprintf(out, "/* Class of every block size up to SIZE_CLASS_LOOKUP_MAX, indexed by size / %d */\n",
+            ALIGNMENT);
+    fprintf(out, "static const unsigned char size_class_lookup[SIZE_CLASS_LOOKUP_MAX / %d + 1] = {",
+            ALIGNMENT);
+    c = 0;
+    for (s = 0; s <= lookup_max; s += ALIGNMENT) {
+        while (c < nsmall && bounds[c] < s)
+            c++;
+        fprintf(out, "%s%d%s", (s / ALIGNMENT % 16 == 0) ? "\n    " : " ",
+                c, (s + ALIGNMENT <= lookup_max) ? "," : "\n");
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "#define SIZE_CLASS(size) ((size) <= SIZE_CLASS_LOOKUP_MAX ? \\\n");
+    fprintf(out, "    size_class_lookup[(size) / %d] : NUM_SIZE_CLASSES - 1)\n\n", ALIGNMENT);
+    fprintf(out, "#endif /* __SIZECLASS_H_ */\n");
+}
+
+int main(int argc, char **argv)
+{
+    int c, i, m, nsmall;
+    int nclasses = DEF_CLASSES;
+    char *outfile = NULL;
+    FILE *out = stdout;
+    unsigned *sizes, *bounds;
+    double *w, large = 0, total = 0;
+
+    while ((c = getopt(argc, argv, "n:m:o:h")) != EOF) {
+        switch (c) {
+        case 'n':
+            nclasses = atoi(optarg);
+            break;
+        case 'm':
+            lookup_max = atoi(optarg);
+            break;
+        case 'o':
+            outfile = optarg;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind == argc || nclasses < 2 || nclasses > 256 ||
+        lookup_max % ALIGNMENT != 0) {
+        usage();
+        exit(1);
+    }
+
+    counts = calloc(lookup_max / ALIGNMENT + 1, sizeof(double));
+    sizes = calloc(lookup_max / ALIGNMENT + 1, sizeof(unsigned));
+    w = calloc(lookup_max / ALIGNMENT + 1, sizeof(double));
+    bounds = calloc(nclasses, sizeof(unsigned));
+    if (!counts || !sizes || !w || !bounds) {
+        fprintf(stderr, "calloc failed\n");
+        exit(1);
+    }
+
+    for (i = optind; i < argc; i++)
+        read_sizes(argv[i], &large);
+
+    /* Collect the distinct sizes that occur, in increasing order */
+    m = 0;
+    for (i = 0; i <= (int)(lookup_max / ALIGNMENT); i++) {
+        if (counts[i] > 0) {
+            sizes[m] = i * ALIGNMENT;
+            w[m++] = counts[i];
+            total += counts[i];
+        }
+    }
+    nsmall = partition(sizes, w, m, nclasses - 1, bounds);
+
+    if (outfile && (out = fopen(outfile, "w")) == NULL) {
+        fprintf(stderr, "Could not open %s\n", outfile);
+        exit(1);
+    }
+    write_header(out, bounds, nsmall, argc - optind, argv + optind);
+    if (out != stdout)
+        fclose(out);
+
+    fprintf(stderr, "%.0f requests, %d distinct sizes <= %u, %.0f larger; %d classes\n",
+            total + large, m, lookup_max, large, nsmall + 1);
+    return 0;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: gen_sizeclass [-h] [-n <classes>] [-m <max>] [-o <file>] <trace>...\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-m <max>   Largest block size in the lookup array (default %d).\n",
+            DEF_LOOKUP_MAX);
+    fprintf(stderr, "\t-n <n>     Number of classes incl. the large class (default %d).\n",
+            DEF_CLASSES);
+    fprintf(stderr, "\t-o <file>  Write the header to <file> instead of stdout.\n");
+}
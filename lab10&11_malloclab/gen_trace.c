@@ -0,0 +1,576 @@
+/*
+ * gen_trace.c - Generate large synthetic allocation traces
+ *
+ * Allocates <blocks> blocks with sizes drawn from a size distribution
+ * and frees them according to a lifetime model, optionally resizing
+ * random live blocks with realloc. Every block is freed by the end of
+ * the trace. Each operation takes O(1) (O(log live) for the timed
+ * models), so traces of millions of requests take seconds, where the
+ * perl generators in traces/ are quadratic.
+ *
+ * Size distributions (-d):
+ *     uniform:<min>:<max>          every size in [min, max] equally likely
+ *     power:<min>:<max>:<alpha>    density proportional to size^-alpha
+ *     bimodal:<s1>:<s2>:<pct>      s1 with probability pct%, else s2
+ *     hist:<file>                  "<size> <count>" lines
+ *     trace:<file>                 the alloc/realloc sizes of a .rep
+ *
+ * Lifetime models (-L), with <live> the mean number of live blocks:
+ *     lifo                  the newest live block is freed first
+ *     fifo                  the oldest live block is freed first
+ *     exp                   lifetimes exponential with mean <live> allocs
+ *     gen:<pct>:<ratio>     generational: pct% of the blocks die young,
+ *                           the rest live <ratio> times longer
+ *
+ * The trace is written as a .rep, or in the binary format of trace.h
+ * with -b or when the output name ends in .bin. The same seed gives
+ * the same trace.
+ *
+ * Usage: gen_trace [-b] [-n <blocks>] [-l <live>] [-r <pct>] [-S <seed>]
+ *                  [-d <dist>] [-L <model>] -o <file>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <math.h>
+
+#include "trace.h"
+
+#define MAXLINE 1024
+#define DEF_BLOCKS 1000000    /* blocks allocated */
+#define DEF_LIVE 1000         /* mean live blocks */
+#define DEF_YOUNG_PCT 90      /* gen: blocks that die young */
+#define DEF_OLD_RATIO 100     /* gen: lifetime of old over young blocks */
+
+/* Size distributions */
+enum {DIST_UNIFORM, DIST_POWER, DIST_TABLE};
+
+/* Lifetime models */
+enum {LIFE_LIFO, LIFE_FIFO, LIFE_EXP, LIFE_GEN};
+
+/* Live block of the timed models */
+typedef struct {
+    double death;             /* allocation count at which it is freed */
+    unsigned int id;
+} live_t;
+
+static int dist = DIST_UNIFORM;
+static double dist_min = 1, dist_max = 4096, alpha = 2;
+static unsigned *table_sizes; /* DIST_TABLE: distinct sizes */
+static double *table_prob;    /* alias method: probability of own size */
+static unsigned *table_alias; /* alias method: index of other size */
+static unsigned table_n;
+
+static int model = LIFE_LIFO;
+static double young_pct = DEF_YOUNG_PCT, old_ratio = DEF_OLD_RATIO;
+
+static unsigned long long rng_state;
+
+static void usage(void);
+
+/*
+ * rng - Next 64 random bits (xorshift64*)
+ */
+static unsigned long long rng(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ull;
+}
+
+/*
+ * uniform - Random double in [0, 1)
+ */
+static double uniform(void)
+{
+    return (rng() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Size of a histogram or trace, and its number of requests */
+typedef struct {
+    unsigned size;
+    double count;
+} sizecount_t;
+
+/*
+ * add_size - Append n requests of size s to the table being read
+ */
+static void add_size(sizecount_t **table, unsigned *cap, unsigned s, double n)
+{
+    if (table_n == *cap) {
+        *cap = *cap ? 2 * *cap : 256;
+        if ((*table = realloc(*table, *cap * sizeof(sizecount_t))) == NULL) {
+            fprintf(stderr, "realloc failed\n");
+            exit(1);
+        }
+    }
+    (*table)[table_n].size = s ? s : 1;
+    (*table)[table_n++].count = n;
+}
+
+/*
+ * cmp_size - qsort comparison of table entries by size
+ */
+static int cmp_size(const void *a, const void *b)
+{
+    unsigned x = ((const sizecount_t *)a)->size;
+    unsigned y = ((const sizecount_t *)b)->size;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * read_table - Read a histogram ("<size> <count>" lines) or the request
+ *     sizes of a .rep trace into the size table. A trace contributes the
+ *     payload of each malloc, calloc, memalign and realloc, once per
+ *     block of a batch; frees are skipped.
+ */
+static void read_table(char *path, int is_trace, sizecount_t **table)
+{
+    FILE *fp;
+    char line[MAXLINE];
+    unsigned cap = 0, size;
+    unsigned long long payload;
+    traceop_t op;
+    double n;
+    int hdr[4], lineno = 0, rc;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+        fprintf(stderr, "Could not open %s\n", path);
+        exit(1);
+    }
+    if (!is_trace) {
+        while (fscanf(fp, "%u %lf", &size, &n) == 2)
+            if (n > 0)
+                add_size(table, &cap, size, n);
+    } else {
+        if (fscanf(fp, "%d %d %d %d", &hdr[0], &hdr[1], &hdr[2], &hdr[3]) != 4) {
+            fprintf(stderr, "Bad trace header in %s\n", path);
+            exit(1);
+        }
+        while (fgets(line, MAXLINE, fp) != NULL) {
+            lineno++;
+            if ((rc = trace_parse_op(line, &op)) == 0)
+                continue;
+            if (rc < 0) {
+                fprintf(stderr, "Bad request on line %d of %s: %s",
+                        lineno, path, line);
+                exit(1);
+            }
+            if (op.type == FREE || op.type == SIZED_FREE ||
+                op.type == BATCH_FREE)
+                continue;
+            payload = OP_PAYLOAD(&op);
+            if (payload > 0xffffffffULL) {
+                fprintf(stderr, "Size %llu on line %d of %s is too large\n",
+                        payload, lineno, path);
+                exit(1);
+            }
+            add_size(table, &cap, (unsigned)payload, OP_IDS(&op));
+        }
+    }
+    fclose(fp);
+    if (table_n == 0) {
+        fprintf(stderr, "No sizes in %s\n", path);
+        exit(1);
+    }
+}
+
+/*
+ * build_alias - Merge the entries of the table with equal sizes and build
+ *     the alias tables of Walker's method from their counts, so that a
+ *     size is drawn with one uniform number
+ */
+static void build_alias(sizecount_t *table)
+{
+    unsigned *small, *large;
+    unsigned i, n, ns = 0, nl = 0, s, l;
+    double *counts, total = 0;
+
+    qsort(table, table_n, sizeof(sizecount_t), cmp_size);
+    for (i = n = 0; i < table_n; i++) {
+        if (n > 0 && table[n - 1].size == table[i].size)
+            table[n - 1].count += table[i].count;
+        else
+            table[n++] = table[i];
+    }
+    table_n = n;
+
+    table_sizes = malloc(table_n * sizeof(unsigned));
+    counts = malloc(table_n * sizeof(double));
+    table_prob = malloc(table_n * sizeof(double));
+    table_alias = malloc(table_n * sizeof(unsigned));
+    small = malloc(table_n * sizeof(unsigned));
+    large = malloc(table_n * sizeof(unsigned));
+    if (!table_sizes || !counts || !table_prob || !table_alias || !small || !large) {
+        fprintf(stderr, "malloc failed\n");
+        exit(1);
+    }
+    for (i = 0; i < table_n; i++) {
+        table_sizes[i] = table[i].size;
+        counts[i] = table[i].count;
+    }
+    for (i = 0; i < table_n; i++)
+        total += counts[i];
+    for (i = 0; i < table_n; i++) {
+        table_prob[i] = counts[i] * table_n / total;
+        table_alias[i] = i;
+        if (table_prob[i] < 1)
+            small[ns++] = i;
+        else
+            large[nl++] = i;
+    }
+    /* Fill each underfull slot with the surplus of an overfull one */
+    while (ns > 0 && nl > 0) {
+        s = small[--ns];
+        l = large[nl - 1];
+        table_alias[s] = l;
+        table_prob[l] -= 1 - table_prob[s];
+        if (table_prob[l] < 1) {
+            nl--;
+            small[ns++] = l;
+        }
+    }
+    while (nl > 0)
+        table_prob[large[--nl]] = 1;
+    while (ns > 0)
+        table_prob[small[--ns]] = 1;
+    free(counts);
+    free(small);
+    free(large);
+}
+
+/*
+ * parse_dist - Set the size distribution from a -d argument
+ */
+static void parse_dist(char *arg)
+{
+    double a, b, c;
+    sizecount_t *table = NULL;
+
+    if (sscanf(arg, "uniform:%lf:%lf", &a, &b) == 2 && a >= 1 && b >= a) {
+        dist = DIST_UNIFORM;
+        dist_min = a;
+        dist_max = b;
+    } else if (sscanf(arg, "power:%lf:%lf:%lf", &a, &b, &c) == 3 &&
+               a >= 1 && b >= a && c > 0) {
+        dist = DIST_POWER;
+        dist_min = a;
+        dist_max = b;
+        alpha = c;
+    } else if (sscanf(arg, "bimodal:%lf:%lf:%lf", &a, &b, &c) == 3 &&
+               a >= 1 && b >= 1 && c >= 0 && c <= 100) {
+        unsigned cap = 0;
+
+        dist = DIST_TABLE;
+        add_size(&table, &cap, (unsigned)a, c);
+        add_size(&table, &cap, (unsigned)b, 100 - c);
+        build_alias(table);
+    } else if (strncmp(arg, "hist:", 5) == 0 || strncmp(arg, "trace:", 6) == 0) {
+        dist = DIST_TABLE;
+        read_table(strchr(arg, ':') + 1, arg[0] == 't', &table);
+        build_alias(table);
+    } else {
+        fprintf(stderr, "Bad size distribution: %s\n", arg);
+        exit(1);
+    }
+    free(table);
+}
+
+/*
+ * parse_model - Set the lifetime model from a -L argument
+ */
+static void parse_model(char *arg)
+{
+    if (strcmp(arg, "lifo") == 0)
+        model = LIFE_LIFO;
+    else if (strcmp(arg, "fifo") == 0)
+        model = LIFE_FIFO;
+    else if (strcmp(arg, "exp") == 0)
+        model = LIFE_EXP;
+    else if (strcmp(arg, "gen") == 0 ||
+             (sscanf(arg, "gen:%lf:%lf", &young_pct, &old_ratio) == 2 &&
+              young_pct >= 0 && young_pct <= 100 && old_ratio >= 1))
+        model = LIFE_GEN;
+    else {
+        fprintf(stderr, "Bad lifetime model: %s\n", arg);
+        exit(1);
+    }
+}
+
+/*
+ * draw_size - Draw a request size from the size distribution
+ */
+static unsigned draw_size(void)
+{
+    double u = uniform();
+    unsigned i;
+
+    switch (dist) {
+    case DIST_UNIFORM:
+        return (unsigned)(dist_min + u * (dist_max - dist_min + 1));
+    case DIST_POWER:
+        /* Inverse of the CDF of the power law truncated to [min, max] */
+        if (alpha == 1)
+            return (unsigned)(dist_min * pow(dist_max / dist_min, u));
+        return (unsigned)pow(pow(dist_min, 1 - alpha) + u *
+                             (pow(dist_max, 1 - alpha) - pow(dist_min, 1 - alpha)),
+                             1 / (1 - alpha));
+    default:
+        i = (unsigned)(u * table_n);
+        u = u * table_n - i;
+        return table_sizes[(u < table_prob[i]) ? i : table_alias[i]];
+    }
+}
+
+/*
+ * heap_push, heap_pop - Min-heap of live blocks by death time
+ */
+static void heap_push(live_t *heap, unsigned *n, live_t x)
+{
+    unsigned i = (*n)++, parent;
+
+    while (i > 0 && heap[parent = (i - 1) / 2].death > x.death) {
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = x;
+}
+
+static live_t heap_pop(live_t *heap, unsigned *n)
+{
+    live_t top = heap[0], x = heap[--(*n)];
+    unsigned i = 0, child;
+
+    while ((child = 2 * i + 1) < *n) {
+        if (child + 1 < *n && heap[child + 1].death < heap[child].death)
+            child++;
+        if (heap[child].death >= x.death)
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = x;
+    return top;
+}
+
+int main(int argc, char **argv)
+{
+    int c, binary = 0;
+    char *outfile = NULL;
+    unsigned blocks = DEF_BLOCKS, live = DEF_LIVE, realloc_pct = 0;
+    unsigned id, nlive = 0, head = 0, cap, *ring = NULL, *sizes;
+    unsigned long long num_ops = 0, max_ops, reallocs, bytes = 0, peak = 0;
+    unsigned long long seed = 1;
+    traceop_t *ops;
+    live_t *heap = NULL, x;
+    tracehdr_t hdr;
+    FILE *out;
+    double mean;
+
+    while ((c = getopt(argc, argv, "bn:l:r:S:d:L:o:h")) != EOF) {
+        switch (c) {
+        case 'b':
+            binary = 1;
+            break;
+        case 'n':
+            blocks = strtoul(optarg, NULL, 0);
+            break;
+        case 'l':
+            live = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            realloc_pct = atoi(optarg);
+            break;
+        case 'S':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'd':
+            parse_dist(optarg);
+            break;
+        case 'L':
+            parse_model(optarg);
+            break;
+        case 'o':
+            outfile = optarg;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (outfile == NULL || optind != argc || blocks == 0 || live == 0 ||
+        realloc_pct >= 100) {
+        usage();
+        exit(1);
+    }
+    if (blocks - 1 > TRACE_MAX_INDEX) {
+        fprintf(stderr, "At most %u blocks\n", TRACE_MAX_INDEX + 1);
+        exit(1);
+    }
+    if (strlen(outfile) >= 4 && strcmp(outfile + strlen(outfile) - 4, ".bin") == 0)
+        binary = 1;
+    rng_state = seed * 0x9e3779b97f4a7c15ull + 1;
+
+    /* Every block is allocated and freed once; reallocs come on top */
+    max_ops = 2ull * blocks;
+    reallocs = max_ops * realloc_pct / (100 - realloc_pct);
+    max_ops += reallocs;
+    cap = (model == LIFE_LIFO || model == LIFE_FIFO) ? 2 * live : 1024;
+    ops = malloc(max_ops * sizeof(traceop_t));
+    sizes = malloc((size_t)blocks * sizeof(unsigned));
+    if (model == LIFE_LIFO || model == LIFE_FIFO)
+        ring = malloc(cap * sizeof(unsigned));
+    else
+        heap = malloc(cap * sizeof(live_t));
+    if (!ops || !sizes || (!ring && !heap)) {
+        fprintf(stderr, "malloc failed\n");
+        exit(1);
+    }
+
+/* Append a request to the trace */
+#define EMIT(t, i, s) do { \
+    ops[num_ops].type = (t); ops[num_ops].index = (i); \
+    ops[num_ops].aux = 0; ops[num_ops++].size = (s); } while (0)
+
+/* Free block i */
+#define FREE_BLOCK(i) do { \
+    EMIT(FREE, (i), 0); bytes -= sizes[i]; } while (0)
+
+    id = 0;
+    while (id < blocks || nlive > 0) {
+        /* Resize a random live block */
+        if (realloc_pct > 0 && nlive > 0 && reallocs > 0 &&
+            rng() % 100 < realloc_pct) {
+            unsigned k = rng() % nlive, victim, s = draw_size();
+
+            if (ring)
+                victim = ring[(head + k) % cap];
+            else
+                victim = heap[k].id;
+            EMIT(REALLOC, victim, s);
+            reallocs--;
+            bytes += s - (long long)sizes[victim];
+            sizes[victim] = s;
+        }
+
+        else if (ring) {
+            /* Random walk of the live count between 0 and 2 * live */
+            if (id < blocks && (nlive == 0 ||
+                                (nlive < cap && (rng() & 1)))) {
+                sizes[id] = draw_size();
+                EMIT(ALLOC, id, sizes[id]);
+                bytes += sizes[id];
+                ring[(head + nlive++) % cap] = id++;
+            } else if (model == LIFE_LIFO) {
+                nlive--;
+                FREE_BLOCK(ring[(head + nlive) % cap]);
+            } else {
+                FREE_BLOCK(ring[head]);
+                head = (head + 1) % cap;
+                nlive--;
+            }
+        }
+
+        else {
+            /* Free the blocks that died, then allocate at time id */
+            if (id < blocks && (nlive == 0 || heap[0].death > id)) {
+                mean = live;
+                if (model == LIFE_GEN) {
+                    /* Scale so that the mean lifetime stays live allocs */
+                    mean = live / (young_pct / 100 +
+                                   (1 - young_pct / 100) * old_ratio);
+                    if (uniform() * 100 >= young_pct)
+                        mean *= old_ratio;
+                }
+                x.death = id - mean * log(1 - uniform());
+                x.id = id;
+                if (nlive == cap) {
+                    cap *= 2;
+                    if ((heap = realloc(heap, cap * sizeof(live_t))) == NULL) {
+                        fprintf(stderr, "realloc failed\n");
+                        exit(1);
+                    }
+                }
+                heap_push(heap, &nlive, x);
+                sizes[id] = draw_size();
+                EMIT(ALLOC, id, sizes[id]);
+                bytes += sizes[id];
+                id++;
+            } else {
+                x = heap_pop(heap, &nlive);
+                FREE_BLOCK(x.id);
+            }
+        }
+        if (bytes > peak)
+            peak = bytes;
+    }
+#undef EMIT
+#undef FREE_BLOCK
+
+    /* Write the trace */
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.sugg_heapsize = (peak > 0x7fffffff) ? 0x7fffffff : (int)peak;
+    hdr.num_ids = blocks;
+    hdr.num_ops = num_ops;
+    hdr.weight = 1;
+    if ((out = fopen(outfile, binary ? "wb" : "w")) == NULL) {
+        fprintf(stderr, "Could not open %s\n", outfile);
+        exit(1);
+    }
+    if (binary) {
+        memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+        hdr.version = TRACE_VERSION;
+        hdr.op_size = sizeof(traceop_t);
+        fwrite(&hdr, sizeof(hdr), 1, out);
+        fwrite(ops, sizeof(traceop_t), num_ops, out);
+    } else {
+        unsigned long long i;
+
+        fprintf(out, "%d\n%d\n%d\n%d\n", hdr.sugg_heapsize, hdr.num_ids,
+                hdr.num_ops, hdr.weight);
+        for (i = 0; i < num_ops; i++) {
+            if (ops[i].type == FREE)
+                fprintf(out, "f %u\n", ops[i].index);
+            else
+                fprintf(out, "%c %u %llu\n", (ops[i].type == ALLOC) ? 'a' : 'r',
+                        ops[i].index, ops[i].size);
+        }
+    }
+    if (fclose(out) != 0) {
+        fprintf(stderr, "Could not write %s\n", outfile);
+        exit(1);
+    }
+
+    fprintf(stderr, "%s: %llu ops, %u ids, peak %llu live bytes\n",
+            outfile, num_ops, blocks, peak);
+    return 0;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: gen_trace [-hb] [-n <blocks>] [-l <live>] [-r <pct>] [-S <seed>]\n");
+    fprintf(stderr, "                 [-d <dist>] [-L <model>] -o <file>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-b         Write the binary trace format.\n");
+    fprintf(stderr, "\t-d <dist>  Size distribution: uniform:<min>:<max> (default 1:4096),\n");
+    fprintf(stderr, "\t           power:<min>:<max>:<alpha>, bimodal:<s1>:<s2>:<pct>,\n");
+    fprintf(stderr, "\t           hist:<file> or trace:<file>.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-l <live>  Mean number of live blocks (default %d).\n", DEF_LIVE);
+    fprintf(stderr, "\t-L <model> Lifetime model: lifo (default), fifo, exp or\n");
+    fprintf(stderr, "\t           gen:<pct>:<ratio> (default %d:%d).\n",
+            DEF_YOUNG_PCT, DEF_OLD_RATIO);
+    fprintf(stderr, "\t-n <n>     Number of blocks to allocate (default %d).\n", DEF_BLOCKS);
+    fprintf(stderr, "\t-o <file>  Write the trace to <file>.\n");
+    fprintf(stderr, "\t-r <pct>   Percent of requests that realloc a live block.\n");
+    fprintf(stderr, "\t-S <seed>  Random seed (default 1).\n");
+}
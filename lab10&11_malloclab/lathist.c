@@ -0,0 +1,65 @@
+/*
+ * lathist.c - Log-linear latency histograms (see lathist.h)
+ */
+#include <string.h>
+#include "lathist.h"
+
+/*
+ * lathist_clear - Forget every value recorded in h
+ */
+void lathist_clear(lathist_t *h)
+{
+    memset(h, 0, sizeof(lathist_t));
+}
+
+/*
+ * lathist_merge - Add the values recorded in h to into
+ */
+void lathist_merge(lathist_t *into, lathist_t *h)
+{
+    int i;
+
+    for (i = 0; i < LATHIST_BUCKETS; i++)
+	into->counts[i] += h->counts[i];
+    into->count += h->count;
+    if (h->max > into->max)
+	into->max = h->max;
+}
+
+/*
+ * bucket_high - Largest value counted in bucket i
+ */
+static lattick_t bucket_high(int i)
+{
+    int shift;
+
+    if (i < 2 * LATHIST_SUB)
+	return i;
+    shift = i / LATHIST_SUB - 1;
+    return (((lattick_t)(i % LATHIST_SUB + LATHIST_SUB + 1)) << shift) - 1;
+}
+
+/*
+ * lathist_percentile - Return the value that p percent of the values 
+ *     in h are at or below, rounded up to the top of its bucket (and 
+ *     capped at the largest value seen). Returns 0 if h is empty.
+ */
+lattick_t lathist_percentile(lathist_t *h, double p)
+{
+    unsigned long rank, seen = 0;
+    lattick_t high;
+    int i;
+
+    if (h->count == 0)
+	return 0;
+    rank = (unsigned long)(p / 100.0 * h->count);
+    if (rank < p / 100.0 * h->count || rank == 0)
+	rank++;  /* ceiling, and at least the smallest value */
+    for (i = 0; i < LATHIST_BUCKETS; i++) {
+	seen += h->counts[i];
+	if (seen >= rank)
+	    break;
+    }
+    high = bucket_high(i);
+    return (high < h->max) ? high : h->max;
+}
@@ -0,0 +1,76 @@
+/*
+ * lathist.h - Log-linear latency histograms
+ *
+ * A histogram counts values (latencies in timer ticks) in buckets of
+ * fixed relative width: values below 2*LATHIST_SUB are counted exactly,
+ * and every larger power-of-two range [2^k, 2^(k+1)) is split into
+ * LATHIST_SUB equal buckets, so any value is known to within 1/LATHIST_SUB
+ * (about 6%) of itself. Recording is a few instructions, cheap enough
+ * to wrap every allocator call.
+ */
+#ifndef __LATHIST_H_
+#define __LATHIST_H_
+
+#define LATHIST_SUB_BITS 4
+#define LATHIST_SUB (1 << LATHIST_SUB_BITS)  /* buckets per power of two */
+#define LATHIST_BUCKETS (64 * LATHIST_SUB)   /* covers every 64-bit value */
+
+typedef unsigned long long lattick_t;
+
+typedef struct {
+    unsigned long counts[LATHIST_BUCKETS];
+    unsigned long count;     /* values recorded */
+    lattick_t max;           /* largest value recorded */
+} lathist_t;
+
+/*
+ * lathist_now - Read the timer that latencies are measured with: the
+ *     time-stamp counter on x86 (in cycles), else the monotonic clock
+ *     (in ns). LATHIST_UNIT names the unit.
+ */
+#if defined(__i386__) || defined(__x86_64__)
+#define LATHIST_UNIT "cycles"
+static inline lattick_t lathist_now(void)
+{
+    unsigned hi, lo;
+
+    asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((lattick_t)hi << 32) | lo;
+}
+#else
+#include <time.h>
+#define LATHIST_UNIT "ns"
+static inline lattick_t lathist_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (lattick_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+/* lathist_bucket - Bucket of value v */
+static inline int lathist_bucket(lattick_t v)
+{
+    int shift;
+
+    if (v < 2 * LATHIST_SUB)
+	return (int)v;
+    shift = 63 - __builtin_clzll(v) - LATHIST_SUB_BITS;
+    return shift * LATHIST_SUB + (int)(v >> shift);
+}
+
+/* lathist_record - Count value v in h */
+static inline void lathist_record(lathist_t *h, lattick_t v)
+{
+    h->counts[lathist_bucket(v)]++;
+    h->count++;
+    if (v > h->max)
+	h->max = v;
+}
+
+void lathist_clear(lathist_t *h);
+void lathist_merge(lathist_t *into, lathist_t *h);
+lattick_t lathist_percentile(lathist_t *h, double p);
+
+#endif /* __LATHIST_H_ */
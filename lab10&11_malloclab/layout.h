@@ -0,0 +1,45 @@
+#ifndef __LAYOUT_H_
+#define __LAYOUT_H_
+
+/*
+ * layout.h - The heap layout snapshots written by mm_dump_layout
+ *
+ * A snapshot is a layouthdr_t followed by layoutrun_t records up to the
+ * end of the file, one per run of adjacent blocks of the same size,
+ * state and size class, in address order from the first block after
+ * the prologue to the epilogue. Since the runs cover every block, a
+ * reader gets back the offset of every block; and since a heap of many
+ * identical blocks collapses into few runs, snapshotting a large heap
+ * costs one walk over its headers and writes little. Snapshots are in
+ * host byte order; the header's version and run_size fields reject
+ * files written with a different layout. layoutview renders them.
+ */
+
+#define LAYOUT_MAGIC "MMLAYOUT"  /* first 8 bytes of a snapshot */
+#define LAYOUT_VERSION 2        /* 1 had 32-bit block sizes */
+
+/* Flags of a layoutrun_t */
+#define LAYOUT_ALLOCATED 0x1  /* the blocks are allocated (else free) */
+#define LAYOUT_GROWN 0x2      /* they grew by realloc before (GROW_BIT) */
+
+/* Header of a snapshot; the layoutrun_t records follow it */
+typedef struct {
+    char magic[8];               /* LAYOUT_MAGIC, not NUL terminated */
+    unsigned int version;        /* LAYOUT_VERSION */
+    unsigned int run_size;       /* sizeof(layoutrun_t) */
+    unsigned long long heap_lo;  /* address of the first heap byte */
+    unsigned long long heap_size;/* bytes of the heap */
+    unsigned int num_classes;    /* size classes of the allocator */
+    unsigned int pad;
+} layouthdr_t;
+
+/* A run of count adjacent blocks of size bytes each */
+typedef struct {
+    unsigned long long offset;   /* of the first block's header from heap_lo */
+    unsigned long long size;     /* bytes of each block, header and footer too */
+    unsigned int count;          /* blocks in the run */
+    unsigned short flags;        /* LAYOUT_* */
+    unsigned short size_class;   /* free list the size belongs to */
+} layoutrun_t;
+
+#endif /* __LAYOUT_H_ */
@@ -0,0 +1,220 @@
+/*
+ * layoutview.c - Render a heap layout snapshot written by mm_dump_layout
+ *
+ * Prints the blocks, the free bytes and the largest free block of the
+ * heap, the free bytes of each size class, and a density map: rows of
+ * characters, each standing for an equal slice of the heap, from ' '
+ * (all of it in free blocks) through ".:-=+*#%" to '@' (none of it
+ * free), so that holes left between live blocks show up at a glance.
+ * With -j, the runs of blocks are written as JSON instead.
+ *
+ * Usage: layoutview [-hj] [-w <cols>] [-r <rows>] <snapshot>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "layout.h"
+
+#define MAX_CELLS (1 << 16)   /* largest map, in characters */
+#define MAX_CLASSES 256       /* most size classes listed */
+
+static char shades[] = " .:-=+*#%@";
+
+static void usage(void);
+
+/*
+ * read_runs - Read every run of the snapshot after its header, setting
+ *     *num_runs. Quits if fp does not hold a snapshot of this layout.
+ */
+static layoutrun_t *read_runs(FILE *fp, char *path, layouthdr_t *hdr,
+                              size_t *num_runs)
+{
+    layoutrun_t *runs = NULL;
+    size_t n = 0, max = 0;
+
+    if (fread(hdr, sizeof(*hdr), 1, fp) != 1 ||
+        memcmp(hdr->magic, LAYOUT_MAGIC, sizeof(hdr->magic)) != 0) {
+        fprintf(stderr, "%s: not a heap layout snapshot\n", path);
+        exit(1);
+    }
+    if (hdr->version != LAYOUT_VERSION || hdr->run_size != sizeof(layoutrun_t)) {
+        fprintf(stderr, "%s: snapshot version %u, run size %u; expected %u, %u\n",
+                path, hdr->version, hdr->run_size, LAYOUT_VERSION,
+                (unsigned)sizeof(layoutrun_t));
+        exit(1);
+    }
+    for (;;) {
+        if (n == max) {
+            max = max ? 2 * max : 1024;
+            if ((runs = realloc(runs, max * sizeof(layoutrun_t))) == NULL) {
+                fprintf(stderr, "realloc failed in read_runs\n");
+                exit(1);
+            }
+        }
+        if (fread(&runs[n], sizeof(layoutrun_t), 1, fp) != 1)
+            break;
+        n++;
+    }
+    if (ferror(fp)) {
+        fprintf(stderr, "%s: read error\n", path);
+        exit(1);
+    }
+    *num_runs = n;
+    return runs;
+}
+
+/*
+ * print_json - Write the header and every run as one JSON object
+ */
+static void print_json(layouthdr_t *hdr, layoutrun_t *runs, size_t num_runs)
+{
+    size_t i;
+
+    printf("{\"heap_lo\": %llu, \"heap_size\": %llu, \"num_classes\": %u, "
+           "\"runs\": [", hdr->heap_lo, hdr->heap_size, hdr->num_classes);
+    for (i = 0; i < num_runs; i++)
+        printf("%s\n  {\"offset\": %llu, \"size\": %llu, \"count\": %u, "
+               "\"allocated\": %s, \"grown\": %s, \"class\": %u}",
+               i ? "," : "", runs[i].offset, runs[i].size, runs[i].count,
+               (runs[i].flags & LAYOUT_ALLOCATED) ? "true" : "false",
+               (runs[i].flags & LAYOUT_GROWN) ? "true" : "false",
+               runs[i].size_class);
+    printf("\n]}\n");
+}
+
+/*
+ * print_map - Print the summary, the free bytes per size class and the
+ *     density map of cols x rows cells
+ */
+static void print_map(layouthdr_t *hdr, layoutrun_t *runs, size_t num_runs,
+                      int cols, int rows)
+{
+    static double cell_free[MAX_CELLS];
+    static unsigned long long class_free[MAX_CLASSES];
+    unsigned long long blocks = 0, free_blocks = 0, free_bytes = 0;
+    unsigned long long largest = 0, lo, hi, cell_lo, cell_hi, bytes;
+    double cell_size, frac;
+    int cells = cols * rows, c, r, shade;
+    size_t i;
+
+    for (i = 0; i < num_runs; i++) {
+        bytes = runs[i].size * runs[i].count;
+        blocks += runs[i].count;
+        if (runs[i].flags & LAYOUT_ALLOCATED)
+            continue;
+        free_blocks += runs[i].count;
+        free_bytes += bytes;
+        if (runs[i].size > largest)
+            largest = runs[i].size;
+        if (runs[i].size_class < MAX_CLASSES)
+            class_free[runs[i].size_class] += bytes;
+    }
+
+    printf("heap %llu bytes, %llu blocks in %lu runs\n", hdr->heap_size,
+           blocks, (unsigned long)num_runs);
+    printf("free %llu bytes (%.1f%%) in %llu blocks, largest %llu bytes\n",
+           free_bytes, hdr->heap_size ? 100.0 * free_bytes / hdr->heap_size : 0,
+           free_blocks, largest);
+    printf("external fragmentation (1 - largest/free) %.3f\n",
+           free_bytes ? 1.0 - (double)largest / free_bytes : 0);
+    printf("\nfree bytes by size class:\n");
+    for (c = 0; c < (int)hdr->num_classes && c < MAX_CLASSES; c++)
+        if (class_free[c] != 0)
+            printf("%5d %12llu\n", c, class_free[c]);
+
+    /* Spread the free bytes of each run over the cells it overlaps */
+    if (hdr->heap_size == 0)
+        return;
+    cell_size = (double)hdr->heap_size / cells;
+    for (i = 0; i < num_runs; i++) {
+        if (runs[i].flags & LAYOUT_ALLOCATED)
+            continue;
+        lo = runs[i].offset;
+        hi = lo + runs[i].size * runs[i].count;
+        for (c = (int)(lo / cell_size); c < cells; c++) {
+            cell_lo = (unsigned long long)(c * cell_size);
+            cell_hi = (unsigned long long)((c + 1) * cell_size);
+            if (cell_lo >= hi)
+                break;
+            cell_free[c] += (double)((hi < cell_hi ? hi : cell_hi) -
+                                     (lo > cell_lo ? lo : cell_lo));
+        }
+    }
+
+    printf("\nheap map, %.0f bytes per character (' ' free .. '@' in use):\n",
+           cell_size);
+    for (r = 0; r < rows; r++) {
+        printf("%10llu |", (unsigned long long)(r * cols * cell_size));
+        for (c = r * cols; c < (r + 1) * cols; c++) {
+            frac = 1.0 - cell_free[c] / cell_size;
+            shade = (int)(frac * (sizeof(shades) - 2) + 0.5);
+            shade = shade < 0 ? 0 : shade > (int)sizeof(shades) - 2 ?
+                (int)sizeof(shades) - 2 : shade;
+            putchar(shades[shade]);
+        }
+        printf("|\n");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int c, json = 0, cols = 64, rows = 16;
+    char *path;
+    FILE *fp;
+    layouthdr_t hdr;
+    layoutrun_t *runs;
+    size_t num_runs;
+
+    while ((c = getopt(argc, argv, "jw:r:h")) != EOF) {
+        switch (c) {
+        case 'j':
+            json = 1;
+            break;
+        case 'w':
+            cols = atoi(optarg);
+            break;
+        case 'r':
+            rows = atoi(optarg);
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind != argc - 1 || cols < 1 || rows < 1 || cols * rows > MAX_CELLS) {
+        usage();
+        exit(1);
+    }
+    path = argv[optind];
+    if ((fp = fopen(path, "r")) == NULL) {
+        perror(path);
+        exit(1);
+    }
+    runs = read_runs(fp, path, &hdr, &num_runs);
+    fclose(fp);
+
+    if (json)
+        print_json(&hdr, runs, num_runs);
+    else
+        print_map(&hdr, runs, num_runs, cols, rows);
+    free(runs);
+    return 0;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: layoutview [-hj] [-w <cols>] [-r <rows>] <snapshot>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-j         Write the runs of blocks as JSON instead of the map.\n");
+    fprintf(stderr, "\t-r <rows>  Rows of the map (default 16).\n");
+    fprintf(stderr, "\t-w <cols>  Characters per row of the map (default 64).\n");
+}
@@ -14,12 +14,29 @@
 #include <string.h>
 #include <assert.h>
 #include <float.h>
+#include <limits.h>
+#include <math.h>
 #include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <poll.h>
+#include <sched.h>
+#include <pthread.h>
 
 #include "mm.h"
+#include "allocator.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "ftimer.h"
 #include "config.h"
+#include "trace.h"
+#include "stream.h"
+#include "lathist.h"
+#include "addrtrace.h"
+#include "optime.h"
 
 /**********************
  * Constants and macros
@@ -29,28 +46,40 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define RANGE_CHUNK 1024 /* range tree nodes malloc'd at a time */
+#define IDMAP_EMPTY 0xffffffff /* id of an unused idmap slot */
+#define IDMAP_MIN 1024   /* initial idmap slots (a power of 2) */
+#define THREAD_RUNS 3    /* threaded replays per trace; the fastest counts */
+#define MAX_THREADS 64   /* largest -T */
+#define THREAD_WINDOW 256 /* how far (in trace ops) threads may drift apart */
+#define LATENCY_RUNS 3   /* instrumented replays per trace for -H */
+#define NOISE_SIGMAS 3.0 /* a Kops drop must exceed this many std devs
+                            (more when -R is small, see noise_sigmas)... */
+#define MIN_KOPS_DROP 0.05 /* ... and this fraction of the baseline Kops */
+#define MIN_UTIL_DROP 0.005 /* smallest util drop (absolute) that counts */
+#define MIN_TIMED_SECS 1e-4 /* traces faster than this are compared pooled */
+#define BASENAME(path) (strrchr(path, '/') ? strrchr(path, '/') + 1 : (path))
+#define TIMELINE_MAX 256 /* most heap samples per trace (-U, -u) */
+#define TIMELINE_WIDTH 50 /* columns of the bars of a -U plot */
+#define FAST_EDGE 128    /* bytes filled at each end of a block (-F)... */
+#define FAST_SAMPLES 8   /* ... and words filled in between */
 
 /* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
+#define IS_ALIGNED(p)  ((((size_t)(p)) % ALIGNMENT) == 0)
 
 /****************************** 
  * The key compound data types 
  *****************************/
 
-/* Records the extent of each block's payload */
+/* Records the extent of each block's payload, as a node of the range tree */
 typedef struct range_t {
-    char *lo;              /* low payload address */
+    char *lo;              /* low payload address (tree key) */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    unsigned int prio;     /* random treap priority, max at the root */
+    struct range_t *left;  /* ranges with lower lo (next node in the pool) */
+    struct range_t *right; /* ranges with higher lo */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
-typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
-} traceop_t;
-
 /* Holds the information for one trace file*/
 typedef struct {
     int sugg_heapsize;   /* suggested heap size (unused) */
@@ -58,6 +87,8 @@ typedef struct {
     int num_ops;         /* number of distinct requests */
     int weight;          /* weight for this trace (unused) */
     traceop_t *ops;      /* array of requests */
+    void *map;           /* mapping of a binary tracefile holding ops... */
+    size_t map_len;      /* ... and its length, or NULL and 0 for .rep */
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
 } trace_t;
@@ -70,21 +101,100 @@ typedef struct {
 typedef struct {
     trace_t *trace;  
     range_t *ranges;
+    char ***retired;  /* blocks arrays of earlier replays (see retire_blocks) */
+    int num_retired;
+    int max_retired;
 } speed_t;
 
+/* A live block of a streamed trace */
+typedef struct {
+    unsigned int id;     /* trace id, or IDMAP_EMPTY */
+    size_t size;         /* payload size */
+    char *block;         /* ptr returned by malloc/realloc */
+} idslot_t;
+
+/* 
+ * Maps the ids of the live blocks of a streamed trace to their blocks,
+ * an open-addressing hash table with linear probing. It holds only the
+ * live ids, unlike trace_t's blocks array, which has a slot for every id.
+ */
+typedef struct {
+    idslot_t *slots;     /* array of mask+1 slots */
+    unsigned int mask;   /* number of slots - 1 */
+    unsigned int count;  /* number of live ids */
+} idmap_t;
+
+/* Holds the params to eval_mm_stream, which is timed by ftimer_gettod */
+typedef struct {
+    char *path;          /* tracefile to stream */
+    int tracenum;        /* its number, for error messages */
+    idmap_t *live;       /* live blocks, empty between traces */
+    double ops;          /* out: requests replayed */
+    double util;         /* out: peak payload / heap size */
+    int valid;           /* out: did every request succeed? */
+} stream_params_t;
+
+/* 
+ * One thread's share of a trace in the threaded replay (-T). The ops 
+ * on each id must run in trace order even when they are on different
+ * threads, so each op carries its ordinal among the ops on its id, and
+ * waits until the shared seq[id] counter reaches it. So that the live
+ * heap stays close to the trace's, no thread may start an op more than
+ * THREAD_WINDOW ops after the op some other thread is at.
+ */
+typedef struct {
+    trace_t *trace;      /* the trace being replayed */
+    unsigned int *seq;   /* seq[id]: ops on id done so far (shared) */
+    int *progress;       /* progress[t]: trace op thread t is at (shared) */
+    int nthreads;        /* number of threads... */
+    int self;            /* ... and the index of this one */
+    pthread_barrier_t *start; /* lines the threads up before timing */
+    int *ops;            /* indices of this thread's ops in trace->ops... */
+    int *ords;           /* ... and their ordinals among the ops on their id */
+    int num_ops;         /* number of ops of this thread */
+    int cross;           /* frees of blocks another thread allocated */
+    double begin, end;   /* out: when the thread started and finished */
+    int errors;          /* out: ops that failed... */
+    int error_op;        /* ... the first one ... */
+    char *error_msg;     /* ... and what went wrong */
+} replay_thread_t;
+
+/* The heap of mm.c after some request of a trace (-U, -u) */
+typedef struct {
+    int op;              /* requests done */
+    size_t heap;         /* heap size */
+    size_t live;         /* payload bytes of the live blocks... */
+    size_t peak;         /* ... and the most there were so far */
+    unsigned long free_bytes;  /* bytes on mm.c's free lists... */
+    unsigned long free_blocks; /* ... and the blocks holding them */
+} sample_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* defined for both libc malloc and student malloc package (mm.c) */
     double ops;      /* number of ops (malloc/free/realloc) in the trace */
     int valid;       /* was the trace processed correctly by the allocator? */
     double secs;     /* number of secs needed to run the trace */
+    double noise;    /* relative std dev of secs over the -R timings */
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    mm_stats_t events; /* extend_heap calls and reallocs during eval_mm_util */
+    lathist_t lat[NUM_OP_TYPES]; /* latency of each call, by op type (-H) */
+    perfctr_t perf;    /* hardware events of one speed run (only with -P) */
+    addrcount_t cache; /* accesses of a traced replay (only with -L, -S) */
+    int num_samples;   /* heap samples taken by eval_mm_util... */
+    sample_t timeline[TIMELINE_MAX]; /* ... at regular intervals (-U, -u) */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
 
+/* What a -j worker process sends back for its trace */
+typedef struct {
+    int errors;          /* errors the worker found */
+    stats_t stats;       /* stats for the trace */
+} result_t;
+
 /********************
  * Global variables
  *******************/
@@ -100,33 +210,141 @@ static char *default_tracefiles[] = {
     DEFAULT_TRACEFILES, NULL
 };
 
+/* Unused range tree nodes, linked through their left pointers */
+static range_t *range_pool = NULL;
+
+/* Number of times each trace is timed; secs is the fastest (-R) */
+static int repeats = 1;
+
+/* If set, also count hardware events of a speed run of each trace (-P) */
+static int count_events = 0;
+
+/* If set, also time every mm call of every trace (-H) */
+static int latency = 0;
+
+/* Number of heap samples eval_mm_util takes per trace, if any (-U, -u) */
+static int timeline_points = 0;
+
+/* If set, fill and check sampled words of each payload, not every byte (-F) */
+static int fast_check = 0;
+
+/* If set, replay each trace once more on the address-traced build of
+ * mm.c, writing the accesses to lackey_file if it is set (-L) and
+ * simulating a cache if addrtrace_cache was called (-S) */
+static int locality = 0;
+static char *lackey_file = NULL; /* "%t" is replaced by the trace name */
+
+/* If set, also trace the application's accesses to the payloads (-D) */
+static int trace_payload = 0;
+
+/* If set, eval_mm_util writes a snapshot of the heap (see layout.h) to
+ * this file when the live payload peaks (-Y); "%t" as in lackey_file */
+static char *layout_file = NULL;
+
+/* Seed of the treap priorities and of the -F fill keys, which start
+ * over from it on every trace, so that a trace is checked the same way
+ * whatever ran before it (-z) */
+static unsigned long long seed = 1;
+static unsigned int range_state;  /* state of range_priority */
+
+/* If set, write the fewest ticks of every op of each trace to this 
+ * file (see optime.h) (-O); "%t" as in lackey_file */
+static char *optime_file = NULL;
+
+/* Number of traces evaluated at once, each in its own process (-j) */
+static int jobs = 1;
+
+/* The allocator under test: mm.c itself (default), one of its policy 
+ * variants or another backend of allocators.c (-m) */
+static allocator_t *mm = &mm_variants[0];
+
 
 /********************* 
  * Function prototypes 
  *********************/
 
-/* these functions manipulate range lists */
-static int add_range(range_t **ranges, char *lo, int size, 
+/* these functions manipulate range trees */
+static range_t *range_node(void);
+static unsigned int range_priority(void);
+static range_t *range_insert(range_t *t, range_t *n);
+static range_t *range_merge(range_t *a, range_t *b);
+static int add_range(range_t **ranges, char *lo, size_t size, 
 		     int tracenum, int opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
 
+/* these functions manipulate the idmap of a streamed trace */
+static void idmap_init(idmap_t *map);
+static idslot_t *idmap_find(idmap_t *map, unsigned int id);
+static idslot_t *idmap_insert(idmap_t *map, unsigned int id);
+static void idmap_remove(idmap_t *map, idslot_t *slot);
+
+/* these functions fill payloads and check that they are preserved */
+static unsigned long long payload_key(unsigned long long x);
+static int fill_range(char *p, size_t lo, size_t hi, unsigned long long key, 
+		      size_t limit, int check);
+static int fill_payload(char *p, size_t size, unsigned long long key, 
+			size_t limit, int check);
+static int check_ends(char *p, size_t size, unsigned long long key);
+static int check_bytes(char *p, size_t size, int byte);
+static int check_zero(char *p, size_t size);
+
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
+static void map_trace(trace_t *trace, FILE *tracefile, char *path);
 static void free_trace(trace_t *trace);
-
-/* Routines for evaluating the correctness and speed of libc malloc */
-static int eval_libc_valid(trace_t *trace, int tracenum);
-static void eval_libc_speed(void *ptr);
+static void reset_heap(trace_t *trace);
+static void retire_blocks(speed_t *speed);
+static void free_retired(speed_t *speed);
+static char *alloc_op(traceop_t *op);
+static void free_op(traceop_t *op, char *p);
+static int batch_op(trace_t *trace, traceop_t *op);
+static void trace_path(char *path, char *pattern, char *tracefile);
 
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   stats_t *stats, char *layout);
+static int peak_op(trace_t *trace);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_latency(trace_t *trace, lathist_t *lat, lattick_t *best);
+static void eval_mm_locality(trace_t *trace, char *tracefile, 
+			     addrcount_t *count);
+static void eval_mm_trace(char *tracefile, int tracenum, stats_t *stats,
+			  range_t **ranges);
+static void eval_mm_package(int num_tracefiles, char **tracefiles, 
+			    stats_t *stats, range_t **ranges);
+static void eval_mm_parallel(int num_tracefiles, char **tracefiles, 
+			     stats_t *stats, range_t **ranges);
+static void eval_mm_stream(void *ptr);
+static void eval_mm_streams(int num_tracefiles, char **tracefiles, 
+			    stats_t *stats);
+static double replay_clock(void);
+static void *replay_thread(void *arg);
+static double replay_threads(trace_t *trace, int tracenum, int nthreads,
+			     replay_thread_t *thr);
+static void eval_mm_threads(int num_tracefiles, char **tracefiles, 
+			    int nthreads);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printvariants(int n, allocator_t **list, stats_t **stats);
+static void printevents(int n, stats_t *stats);
+static void printlatency(int n, stats_t *stats);
+static void printperf(int n, stats_t *stats);
+static void printlocality(int n, stats_t *stats);
+static void printvariantlocality(int n, allocator_t **list, stats_t **stats);
+static void printtimeline(int n, char **tracefiles, stats_t *stats);
+static void writetimeline(char *path, int n, char **tracefiles, 
+			  stats_t *stats);
+static void writeoptimes(char *path, trace_t *trace, lattick_t *best);
+static void writejson(FILE *fp, char *str);
+static void writeresults(char *path, int n, char **tracefiles, 
+			 stats_t *stats);
+static double noise_sigmas(void);
+static int comparebaseline(char *path, int n, char **tracefiles, 
+			   stats_t *stats);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -141,15 +359,31 @@ int main(int argc, char **argv)
     char c;
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
-    trace_t *trace = NULL;     /* stores a single trace file in memory */
-    range_t *ranges = NULL;    /* keeps track of block extents for one trace */
+    range_t *ranges = NULL;    /* tree of block extents for one trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
-    speed_t speed_params;      /* input parameters to the xx_speed routines */ 
+    stats_t **variant_stats = NULL; /* stats for each compared backend */
+    allocator_t **variants = NULL; /* backends compared by -p or -A */
+    allocator_t *under_test;   /* mm while another backend runs */
+    char *mm_name;             /* what the results of mm are called */
+    int num_variants = 0;      /* number of entries in variants[] */
+    int mm_errors;             /* errors of mm, before the comparison */
 
     int team_check = 0;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int run_variants = 0;/* If set, compare the mm policy variants (-p) */
+    int run_all = 0;     /* If set, compare every allocator backend (-A) */
+    int stream = 0;      /* If set, stream the traces through mm (-s) */
+    int nthreads = 0;    /* If set, replay each trace on n threads (-T) */
+    char *outfile = NULL;/* If set, write the mm results to this file (-o) */
+    char *baseline = NULL;/* If set, compare the mm results with this (-b) */
+    int plot_timeline = 0;/* If set, plot the heap over time (-U) */
+    char *timeline_file = NULL;/* If set, write the heap samples here (-u) */
+    int regressions = 0; /* number of traces worse than the baseline */
+    int k, maxsamples;   /* K-best scheme (-K) */
+    double epsilon;
+    int cache_s, cache_E, cache_b; /* simulated cache (-S) */
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -158,7 +392,7 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:j:m:T:o:b:R:U:u:C:K:c:W:L:S:Y:O:z:hADFHvVgalpPs")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -178,18 +412,138 @@ int main(int argc, char **argv)
 	    if (tracedir[strlen(tracedir)-1] != '/') 
 		strcat(tracedir, "/"); /* path always ends with "/" */
 	    break;
+        case 'j': /* Evaluate up to n traces at once */
+            jobs = atoi(optarg);
+            if (jobs < 1) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'T': /* Replay each trace on n threads at once */
+            nthreads = atoi(optarg);
+            if (nthreads < 1 || nthreads > MAX_THREADS) {
+                usage();
+                exit(1);
+            }
+            break;
         case 'a': /* Don't check team structure */
             team_check = 0;
             break;
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'p': /* Compare the policy variants of mm.c */
+            run_variants = 1;
+            break;
+        case 'A': /* Compare every allocator backend */
+            run_all = 1;
+            break;
+        case 'm': /* Evaluate another allocator backend instead of mm.c */
+            if ((mm = allocators_find(optarg)) == NULL) {
+                allocator_t **a;
+
+                fprintf(stderr, "Unknown allocator %s; one of:", optarg);
+                for (a = allocators_list(); *a != NULL; a++)
+                    fprintf(stderr, " %s", (*a)->name);
+                fprintf(stderr, "\n");
+                exit(1);
+            }
+            break;
+        case 'o': /* Write the mm results as CSV or JSON */
+            outfile = optarg;
+            break;
+        case 'b': /* Compare the mm results with a CSV written by -o */
+            baseline = optarg;
+            break;
+        case 'R': /* Time each trace n times to measure the noise */
+            repeats = atoi(optarg);
+            if (repeats < 1) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'U': /* Plot the heap at n points of each trace */
+            timeline_points = atoi(optarg);
+            if (timeline_points < 1 || timeline_points > TIMELINE_MAX) {
+                usage();
+                exit(1);
+            }
+            plot_timeline = 1;
+            break;
+        case 'u': /* Write the heap samples as CSV */
+            timeline_file = optarg;
+            break;
+        case 'C': /* Run on these CPUs only */
+            if (set_fsecs_cpus(optarg) < 0) {
+                fprintf(stderr, "Cannot run on CPUs %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'K': /* K-best timing: k[:epsilon[:max samples]] */
+            k = atoi(optarg);
+            epsilon = 0.01;
+            maxsamples = (5*k > 20) ? 5*k : 20;
+            if (strchr(optarg, ':') && 
+                sscanf(strchr(optarg, ':'), ":%lf:%d", &epsilon, 
+                       &maxsamples) < 1) {
+                usage();
+                exit(1);
+            }
+            if (k < 1 || epsilon < 0 || maxsamples < k) {
+                usage();
+                exit(1);
+            }
+            set_fsecs_kbest(k, epsilon, maxsamples);
+            break;
+        case 'c': /* Bytes to read to flush the cache before each run */
+            set_fsecs_flush(atoi(optarg));
+            break;
+        case 'W': /* Untimed warmup runs before each timing */
+            set_fsecs_warmup(atoi(optarg));
+            break;
+        case 'L': /* Write the addresses mm.c touches in lackey format */
+            lackey_file = optarg;
+            locality = 1;
+            break;
+        case 'S': /* Simulate a cache of 2^s sets of E lines of 2^b bytes */
+            if (sscanf(optarg, "%d:%d:%d", &cache_s, &cache_E, &cache_b) != 3 
+                || addrtrace_cache(cache_s, cache_E, cache_b) < 0) {
+                usage();
+                exit(1);
+            }
+            locality = 1;
+            break;
+        case 'Y': /* Snapshot the heap layout when the payload peaks */
+            layout_file = optarg;
+            break;
+        case 'O': /* Dump the time of every op */
+            optime_file = optarg;
+            break;
+        case 'z': /* Seed, and time each trace a fixed number of times */
+            seed = strtoull(optarg, NULL, 0);
+            set_fsecs_fixed(1);
+            break;
+        case 'D': /* Trace the payload accesses of the application too */
+            trace_payload = 1;
+            break;
+        case 'F': /* Check sampled words of the payloads, not every byte */
+            fast_check = 1;
+            break;
+        case 'P': /* Count hardware events with perf_event_open */
+            count_events = 1;
+            break;
+        case 's': /* Stream traces in chunks instead of loading them */
+            stream = 1;
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
         case 'V': /* Be more verbose than -v */
             verbose = 2;
             break;
+        case 'H': /* Print latency percentiles of each op type */
+            latency = 1;
+            break;
         case 'h': /* Print this message */
 	    usage();
             exit(0);
@@ -235,6 +589,26 @@ int main(int argc, char **argv)
 	printf("Using default tracefiles in %s\n", tracedir);
     }
 
+    if (timeline_file && timeline_points == 0)
+	timeline_points = TIMELINE_MAX;
+    if (lackey_file && num_tracefiles > 1 && !strstr(lackey_file, "%t")) {
+	fprintf(stderr, "-L needs a file name with %%t for several traces\n");
+	exit(1);
+    }
+    if (layout_file && num_tracefiles > 1 && !strstr(layout_file, "%t")) {
+	fprintf(stderr, "-Y needs a file name with %%t for several traces\n");
+	exit(1);
+    }
+    if (optime_file && num_tracefiles > 1 && !strstr(optime_file, "%t")) {
+	fprintf(stderr, "-O needs a file name with %%t for several traces\n");
+	exit(1);
+    }
+    if (layout_file && !mm->dump_layout) {
+	fprintf(stderr, "Allocator %s cannot dump its heap layout\n", mm->name);
+	exit(1);
+    }
+    mm_name = (mm == &mm_variants[0]) ? "mm" : mm->name;
+
     /* Initialize the timing package */
     init_fsecs();
 
@@ -242,6 +616,8 @@ int main(int argc, char **argv)
      * Optionally run and evaluate the libc malloc package 
      */
     if (run_libc) {
+	char *dumps = optime_file;
+
 	if (verbose > 1)
 	    printf("\nTesting libc malloc\n");
 	
@@ -250,21 +626,14 @@ int main(int argc, char **argv)
 	if (libc_stats == NULL)
 	    unix_error("libc_stats calloc in main failed");
 	
-	/* Evaluate the libc malloc package using the K-best scheme */
-	for (i=0; i < num_tracefiles; i++) {
-	    trace = read_trace(tracedir, tracefiles[i]);
-	    libc_stats[i].ops = trace->num_ops;
-	    if (verbose > 1)
-		printf("Checking libc malloc for correctness, ");
-	    libc_stats[i].valid = eval_libc_valid(trace, i);
-	    if (libc_stats[i].valid) {
-		speed_params.trace = trace;
-		if (verbose > 1)
-		    printf("and performance.\n");
-		libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
-	    }
-	    free_trace(trace);
-	}
+	/* Evaluate the libc backend like mm.c, using the K-best scheme;
+	 * the -O dumps are of mm only */
+	under_test = mm;
+	mm = allocators_find("libc");
+	optime_file = NULL;
+	eval_mm_package(num_tracefiles, tracefiles, libc_stats, &ranges);
+	optime_file = dumps;
+	mm = under_test;
 
 	/* Display the libc results in a compact table */
 	if (verbose) {
@@ -277,7 +646,7 @@ int main(int argc, char **argv)
      * Always run and evaluate the student's mm package
      */
     if (verbose > 1)
-	printf("\nTesting mm malloc\n");
+	printf("\nTesting %s malloc\n", mm_name);
 
     /* Allocate the mm stats array, with one stats_t struct per tracefile */
     mm_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
@@ -287,32 +656,123 @@ int main(int argc, char **argv)
     /* Initialize the simulated memory system in memlib.c */
     mem_init(); 
 
-    /* Evaluate student's mm malloc package using the K-best scheme */
-    for (i=0; i < num_tracefiles; i++) {
-	trace = read_trace(tracedir, tracefiles[i]);
-	mm_stats[i].ops = trace->num_ops;
-	if (verbose > 1)
-	    printf("Checking mm_malloc for correctness, ");
-	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-	if (mm_stats[i].valid) {
-	    if (verbose > 1)
-		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-	    speed_params.trace = trace;
-	    speed_params.ranges = ranges;
-	    if (verbose > 1)
-		printf("and performance.\n");
-	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
-	}
-	free_trace(trace);
-    }
+    /* 
+     * Evaluate student's mm malloc package using the K-best scheme,
+     * or replay each trace once as it is read
+     */
+    if (stream)
+	eval_mm_streams(num_tracefiles, tracefiles, mm_stats);
+    else
+	eval_mm_package(num_tracefiles, tracefiles, mm_stats, &ranges);
 
     /* Display the mm results in a compact table */
     if (verbose) {
-	printf("\nResults for mm malloc:\n");
+	printf("\nResults for %s malloc:\n", mm_name);
 	printresults(num_tracefiles, mm_stats);
 	printf("\n");
     }
+    if (verbose > 1) {
+	printf("Heap events for %s malloc:\n", mm_name);
+	printevents(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (outfile)
+	writeresults(outfile, num_tracefiles, tracefiles, mm_stats);
+    if (baseline) {
+	printf("Comparison with baseline %s:\n", baseline);
+	regressions = comparebaseline(baseline, num_tracefiles, tracefiles, 
+				      mm_stats);
+	printf("\n");
+    }
+    if (count_events && !stream) {
+	printf("Hardware events per op of %s malloc:\n", mm_name);
+	printperf(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (latency && !stream) {
+	printf("Latency of %s malloc calls (%s):\n", mm_name, LATHIST_UNIT);
+	printlatency(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (plot_timeline && !stream) {
+	printf("Heap of %s malloc over time:\n", mm_name);
+	printtimeline(num_tracefiles, tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (timeline_file && !stream)
+	writetimeline(timeline_file, num_tracefiles, tracefiles, mm_stats);
+    if (locality && !stream) {
+	printf("Memory accesses per op of %s malloc:\n", mm_name);
+	printlocality(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+
+    /*
+     * Optionally replay each trace on several threads against the 
+     * threaded mode of mm.c and compare with one thread
+     */
+    if (nthreads > 0) {
+	printf("\nThreaded replay of %s malloc (%d threads):\n", mm_name, 
+	       nthreads);
+	eval_mm_threads(num_tracefiles, tracefiles, nthreads);
+	printf("\n");
+    }
+
+    /*
+     * Optionally run every policy variant of mm.c (-p), or every 
+     * allocator backend (-A), on the same traces and display them 
+     * side by side
+     */
+    if (run_variants || run_all) {
+	if (run_all)
+	    variants = allocators_list();
+	else {
+	    for (i=0; mm_variants[i].name != NULL; i++)
+		;
+	    if ((variants = 
+		 (allocator_t **)calloc(i + 1, sizeof(allocator_t *))) == NULL)
+		unix_error("variants calloc in main failed");
+	    for (i=0; mm_variants[i].name != NULL; i++)
+		variants[i] = &mm_variants[i];
+	}
+	while (variants[num_variants] != NULL)
+	    num_variants++;
+	if ((variant_stats = 
+	     (stats_t **)calloc(num_variants, sizeof(stats_t *))) == NULL)
+	    unix_error("variant_stats calloc in main failed");
+
+	/* A backend that fails (e.g. bump running out of heap) shows 
+	 * as "-" in the table, but does not count against mm */
+	under_test = mm;
+	mm_errors = errors;
+	lackey_file = NULL; /* only mm's accesses, layouts and times are written */
+	layout_file = NULL;
+	optime_file = NULL;
+	for (i=0; i < num_variants; i++) {
+	    if (verbose > 1)
+		printf("\nTesting allocator %s\n", variants[i]->name);
+	    if ((variant_stats[i] = 
+		 (stats_t *)calloc(num_tracefiles, sizeof(stats_t))) == NULL)
+		unix_error("variant_stats calloc in main failed");
+	    mm = variants[i];
+	    eval_mm_package(num_tracefiles, tracefiles, variant_stats[i], 
+			    &ranges);
+	}
+	mm = under_test;
+	errors = mm_errors;
+
+	if (run_all)
+	    printf("\nResults for all allocators (util/Kops):\n");
+	else
+	    printf("\nResults for mm policy variants (util/Kops):\n");
+	printvariants(num_tracefiles, variants, variant_stats);
+	printf("\n");
+	if (locality && addrtrace_cached()) {
+	    printf("Simulated cache misses per op:\n");
+	    printvariantlocality(num_tracefiles, variants, variant_stats);
+	    printf("\n");
+	}
+    }
 
     /* 
      * Accumulate the aggregate statistics for the student's mm package 
@@ -362,27 +822,122 @@ int main(int argc, char **argv)
 	printf("perfidx:%.0f\n", perfindex);
     }
 
+    if (regressions > 0) {
+	printf("%d trace(s) regressed against the baseline\n", regressions);
+	exit(2);
+    }
     exit(0);
 }
 
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps 
+ * The following routines manipulate the range tree, which keeps 
  * track of the extent of every allocated block payload. We use the 
- * range list to detect any overlapping allocated blocks.
+ * range tree to detect any overlapping allocated blocks.
+ *
+ * The tree is a treap keyed by the low payload address: a binary
+ * search tree on lo that is also a max-heap on a random priority,
+ * so it stays balanced in expectation and add_range/remove_range
+ * take O(log n) time instead of a scan of every live block. Since
+ * the payloads in the tree never overlap each other, a new payload
+ * overlaps some payload iff it overlaps the one with the largest lo
+ * at or below its own hi. Nodes come from a pool that is refilled
+ * RANGE_CHUNK nodes at a time and never returned to libc.
  ****************************************************************/
 
+/*
+ * range_node - Take a node off the range pool, refilling it if empty
+ */
+static range_t *range_node(void)
+{
+    range_t *p;
+    int i;
+
+    if (range_pool == NULL) {
+	if ((p = (range_t *)malloc(RANGE_CHUNK * sizeof(range_t))) == NULL)
+	    unix_error("malloc error in range_node");
+	for (i = 0; i < RANGE_CHUNK; i++) {
+	    p[i].left = range_pool;
+	    range_pool = &p[i];
+	}
+    }
+    p = range_pool;
+    range_pool = p->left;
+    return p;
+}
+
+/*
+ * range_priority - Next pseudo-random treap priority (xorshift32),
+ *     from range_state, which eval_mm_valid seeds for every trace
+ */
+static unsigned int range_priority(void)
+{
+    range_state ^= range_state << 13;
+    range_state ^= range_state >> 17;
+    range_state ^= range_state << 5;
+    return range_state;
+}
+
+/*
+ * range_insert - Insert node n into the treap rooted at t, returning 
+ *     the new root
+ */
+static range_t *range_insert(range_t *t, range_t *n)
+{
+    range_t *c;
+
+    if (t == NULL)
+	return n;
+    if (n->lo < t->lo) {
+	t->left = range_insert(t->left, n);
+	if (t->left->prio > t->prio) {  /* rotate right */
+	    c = t->left;
+	    t->left = c->right;
+	    c->right = t;
+	    return c;
+	}
+    }
+    else {
+	t->right = range_insert(t->right, n);
+	if (t->right->prio > t->prio) { /* rotate left */
+	    c = t->right;
+	    t->right = c->left;
+	    c->left = t;
+	    return c;
+	}
+    }
+    return t;
+}
+
+/*
+ * range_merge - Join treaps a and b, where every lo in a is below 
+ *     every lo in b, returning the new root
+ */
+static range_t *range_merge(range_t *a, range_t *b)
+{
+    if (a == NULL)
+	return b;
+    if (b == NULL)
+	return a;
+    if (a->prio > b->prio) {
+	a->right = range_merge(a->right, b);
+	return a;
+    }
+    b->left = range_merge(a, b->left);
+    return b;
+}
+
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of 
  *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list. 
+ *     we create a range struct for this block and add it to the range tree. 
  */
-static int add_range(range_t **ranges, char *lo, int size, 
+static int add_range(range_t **ranges, char *lo, size_t size, 
 		     int tracenum, int opnum)
 {
     char *hi = lo + size - 1;
-    range_t *p;
+    range_t *p, *q;
     char msg[MAXLINE];
 
     assert(size > 0);
@@ -396,35 +951,54 @@ static int add_range(range_t **ranges, char *lo, int size,
     }
 
     /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
-	(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    if ((mm->flags & ALLOC_HEAP) &&
+	((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
+	 (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi()))) {
 	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
 		lo, hi, mem_heap_lo(), mem_heap_hi());
 	malloc_error(tracenum, opnum, msg);
         return 0;
     }
 
-    /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
-	    sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-		    lo, hi, p->lo, p->hi);
-	    malloc_error(tracenum, opnum, msg);
-	    return 0;
-        }
+    /* The backend must not report less payload than was asked for */
+    if (mm->usable_size != NULL && mm->usable_size(lo) < size) {
+	sprintf(msg, "Payload (%p) has usable size %lu < %lu", 
+		lo, (unsigned long)mm->usable_size(lo), (unsigned long)size);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
+    }
+
+    /* 
+     * The payload must not overlap any other payloads. Find the 
+     * payload with the largest lo that is <= hi; it is the only 
+     * one that can overlap.
+     */
+    q = NULL;
+    for (p = *ranges;  p != NULL; ) {
+	if (p->lo <= hi) {
+	    q = p;
+	    p = p->right;
+	}
+	else
+	    p = p->left;
+    }
+    if (q != NULL && q->hi >= lo) {
+	sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
+		lo, hi, q->lo, q->hi);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
     }
 
     /* 
      * Everything looks OK, so remember the extent of this block 
-     * by creating a range struct and adding it the range list.
+     * by taking a range struct from the pool and adding it the range tree.
      */
-    if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
-	unix_error("malloc error in add_range");
-    p->next = *ranges;
+    p = range_node();
     p->lo = lo;
     p->hi = hi;
-    *ranges = p;
+    p->prio = range_priority();
+    p->left = p->right = NULL;
+    *ranges = range_insert(*ranges, p);
     return 1;
 }
 
@@ -435,32 +1009,261 @@ static void remove_range(range_t **ranges, char *lo)
 {
     range_t *p;
     range_t **prevpp = ranges;
-    int size;
 
-    for (p = *ranges;  p != NULL; p = p->next) {
+    for (p = *ranges;  p != NULL; p = *prevpp) {
         if (p->lo == lo) {
-	    *prevpp = p->next;
-            size = p->hi - p->lo + 1;
-            free(p);
+	    *prevpp = range_merge(p->left, p->right);
+	    p->left = range_pool;
+	    range_pool = p;
             break;
         }
-        prevpp = &(p->next);
+	prevpp = (lo < p->lo) ? &(p->left) : &(p->right);
     }
 }
 
 /*
- * clear_ranges - free all of the range records for a trace 
+ * clear_ranges - return all of the range records for a trace to the pool
  */
 static void clear_ranges(range_t **ranges)
 {
-    range_t *p;
-    range_t *pnext;
+    range_t *p = *ranges;
+
+    if (p == NULL)
+	return;
+    clear_ranges(&(p->left));
+    clear_ranges(&(p->right));
+    p->left = range_pool;
+    range_pool = p;
+    *ranges = NULL;
+}
+
+
+/*******************************************************************
+ * The following routines manipulate the idmap, which maps the ids of
+ * the live blocks of a streamed trace to their blocks and sizes.
+ ******************************************************************/
+
+/* Slot where the search for id starts (Fibonacci hashing) */
+#define IDMAP_HASH(map, id) (((id) * 2654435761u) & (map)->mask)
+
+/*
+ * idmap_init - Make map an empty idmap with IDMAP_MIN slots
+ */
+static void idmap_init(idmap_t *map)
+{
+    unsigned int i;
+
+    if ((map->slots = 
+	 (idslot_t *)malloc(IDMAP_MIN * sizeof(idslot_t))) == NULL)
+	unix_error("malloc error in idmap_init");
+    for (i = 0; i < IDMAP_MIN; i++)
+	map->slots[i].id = IDMAP_EMPTY;
+    map->mask = IDMAP_MIN - 1;
+    map->count = 0;
+}
+
+/*
+ * idmap_find - Return the slot of id, or NULL if id is not live
+ */
+static idslot_t *idmap_find(idmap_t *map, unsigned int id)
+{
+    unsigned int i;
+
+    for (i = IDMAP_HASH(map, id); map->slots[i].id != IDMAP_EMPTY; 
+	 i = (i + 1) & map->mask)
+	if (map->slots[i].id == id)
+	    return &map->slots[i];
+    return NULL;
+}
 
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
+/*
+ * idmap_insert - Return the slot of id, adding it if it is not live. 
+ *     The table doubles when it becomes half full.
+ */
+static idslot_t *idmap_insert(idmap_t *map, unsigned int id)
+{
+    idslot_t *old;
+    unsigned int i, n;
+
+    if (2 * (map->count + 1) > map->mask + 1) {
+	old = map->slots;
+	n = map->mask + 1;
+	if ((map->slots = 
+	     (idslot_t *)malloc(2 * n * sizeof(idslot_t))) == NULL)
+	    unix_error("malloc error in idmap_insert");
+	for (i = 0; i < 2 * n; i++)
+	    map->slots[i].id = IDMAP_EMPTY;
+	map->mask = 2 * n - 1;
+	map->count = 0;
+	for (i = 0; i < n; i++)
+	    if (old[i].id != IDMAP_EMPTY)
+		*idmap_insert(map, old[i].id) = old[i];
+	free(old);
     }
-    *ranges = NULL;
+
+    for (i = IDMAP_HASH(map, id); map->slots[i].id != IDMAP_EMPTY; 
+	 i = (i + 1) & map->mask)
+	if (map->slots[i].id == id)
+	    return &map->slots[i];
+    map->slots[i].id = id;
+    map->count++;
+    return &map->slots[i];
+}
+
+/*
+ * idmap_remove - Remove the id in slot, moving later entries of its 
+ *     probe run back so that lookups never stop at the hole early
+ */
+static void idmap_remove(idmap_t *map, idslot_t *slot)
+{
+    unsigned int hole = slot - map->slots;
+    unsigned int i, home;
+
+    for (i = (hole + 1) & map->mask; map->slots[i].id != IDMAP_EMPTY; 
+	 i = (i + 1) & map->mask) {
+	home = IDMAP_HASH(map, map->slots[i].id);
+	/* Move slot i into the hole unless its home lies in (hole, i] */
+	if (((i - home) & map->mask) >= ((i - hole) & map->mask)) {
+	    map->slots[hole] = map->slots[i];
+	    hole = i;
+	}
+    }
+    map->slots[hole].id = IDMAP_EMPTY;
+    map->count--;
+}
+
+
+/*******************************************************************
+ * The following routines fill payloads and check them. The default 
+ * (exhaustive) check fills each payload with the low byte of its id 
+ * and checks every byte. The fast check (-F) fills only the first and
+ * last FAST_EDGE bytes and FAST_SAMPLES words in between, with words
+ * that depend on a key drawn for each fill and on their offset, so
+ * that a copy to the wrong offset or a stale block also fails.
+ ******************************************************************/
+
+/* The word at offset of a payload filled with key */
+#define PAYLOAD_STEP 0x9e3779b97f4a7c15ull
+#define PAYLOAD_WORD(key, offset) ((key) + (unsigned long long)(offset) * PAYLOAD_STEP)
+
+/*
+ * payload_key - Scramble x into a fill key (the splitmix64 finalizer)
+ */
+static unsigned long long payload_key(unsigned long long x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+/*
+ * fill_range - Fill bytes [lo, hi) of payload p with key a word at a
+ *     time, or if check is set, check the ones below limit instead.
+ *     Returns 0 if a checked byte differs, else 1.
+ */
+static int fill_range(char *p, size_t lo, size_t hi, unsigned long long key, 
+		      size_t limit, int check)
+{
+    unsigned long long w = PAYLOAD_WORD(key, lo);
+    size_t o;
+
+    for (o = lo; o + 8 <= hi; o += 8, w += 8 * PAYLOAD_STEP) {
+	if (!check)
+	    memcpy(p + o, &w, 8);
+	else if (o + 8 <= limit) {
+	    if (memcmp(p + o, &w, 8) != 0)
+		return 0;
+	}
+	else  /* the limit cuts this word */
+	    return o >= limit || memcmp(p + o, &w, limit - o) == 0;
+    }
+    /* Bytes after the last whole word */
+    for (; o < hi; o++) {
+	w = PAYLOAD_WORD(key, o);
+	if (!check)
+	    p[o] = (char)w;
+	else if (o < limit && p[o] != (char)w)
+	    return 0;
+    }
+    return 1;
+}
+
+/*
+ * fill_payload - Fill the sampled parts of a payload of size bytes with
+ *     key (-F), or if check is set, check the parts that lie below limit.
+ *     Small payloads are filled whole. Returns 0 if a check fails, else 1.
+ */
+static int fill_payload(char *p, size_t size, unsigned long long key, 
+			size_t limit, int check)
+{
+    unsigned long long r = key, words;
+    size_t o;
+    int k;
+
+    if (size <= 2 * FAST_EDGE)
+	return fill_range(p, 0, size, key, limit, check);
+    if (!fill_range(p, 0, FAST_EDGE, key, limit, check) ||
+	!fill_range(p, size - FAST_EDGE, size, key, limit, check))
+	return 0;
+    /* Interior words between the edges, at offsets drawn by an LCG
+     * seeded with the key */
+    words = (size - 2 * FAST_EDGE) / 8;
+    for (k = 0; k < FAST_SAMPLES && words > 0; k++) {
+	r = r * 6364136223846793005ull + 1442695040888963407ull;
+	/* (r >> 32) * words >> 32, a half of words at a time so that it
+	 * cannot overflow */
+	o = FAST_EDGE + 8 * (size_t)((r >> 32) * (words >> 32) + 
+				     (((r >> 32) * (words & 0xffffffffull)) >> 32));
+
+	if (!fill_range(p, o, o + 8, key, limit, check))
+	    return 0;
+    }
+    return 1;
+}
+
+/*
+ * check_ends - Check the first and last words of a payload filled by
+ *     fill_payload, which lie on the cache lines of its header and
+ *     footer. Returns 0 if either changed, else 1.
+ */
+static int check_ends(char *p, size_t size, unsigned long long key)
+{
+    size_t last = (size <= 2 * FAST_EDGE) ? (size - 1) / 8 * 8 : size - 8;
+
+    return fill_range(p, 0, (size < 8) ? size : 8, key, size, 1) &&
+	fill_range(p, last, size, key, size, 1);
+}
+
+/*
+ * check_bytes - Return 1 if the first size bytes of p all equal byte,
+ *     comparing a word at a time, else 0
+ */
+static int check_bytes(char *p, size_t size, int byte)
+{
+    unsigned long long w, pattern = 0x0101010101010101ull * (unsigned char)byte;
+    size_t o;
+
+    for (o = 0; o + 8 <= size; o += 8) {
+	memcpy(&w, p + o, 8);
+	if (w != pattern)
+	    return 0;
+    }
+    for (; o < size; o++)
+	if ((unsigned char)p[o] != (unsigned char)byte)
+	    return 0;
+    return 1;
+}
+
+/*
+ * check_zero - Return 1 if the payload of a calloc is all zero, or with
+ *     -F, if its first and last FAST_EDGE bytes are, else 0
+ */
+static int check_zero(char *p, size_t size)
+{
+    if (!fast_check || size <= 2 * FAST_EDGE)
+	return check_bytes(p, size, 0);
+    return check_bytes(p, FAST_EDGE, 0) && 
+	check_bytes(p + size - FAST_EDGE, FAST_EDGE, 0);
 }
 
 
@@ -475,11 +1278,13 @@ static trace_t *read_trace(char *tracedir, char *filename)
 {
     FILE *tracefile;
     trace_t *trace;
-    char type[MAXLINE];
+    char line[MAXLINE];
     char path[MAXLINE];
-    unsigned index, size;
-    unsigned max_index = 0;
+    traceop_t op;
+    unsigned last, max_index = 0;
     unsigned op_index;
+    int parsed;
+    char magic[sizeof(TRACE_MAGIC)];
 
     if (verbose > 1)
 	printf("Reading tracefile: %s\n", filename);
@@ -495,19 +1300,29 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	sprintf(msg, "Could not open %s in read_trace", path);
 	unix_error(msg);
     }
-    fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-    fscanf(tracefile, "%d", &(trace->num_ids));     
-    fscanf(tracefile, "%d", &(trace->num_ops));     
-    fscanf(tracefile, "%d", &(trace->weight));        /* not used */
+
+    /* Binary traces are mapped rather than parsed */
+    if (fread(magic, 1, sizeof(magic), tracefile) == sizeof(magic) &&
+	memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0)
+	map_trace(trace, tracefile, path);
+    else {
+	rewind(tracefile);
+	fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
+	fscanf(tracefile, "%d", &(trace->num_ids));     
+	fscanf(tracefile, "%d", &(trace->num_ops));     
+	fscanf(tracefile, "%d", &(trace->weight));        /* not used */
+	trace->map = NULL;
+	trace->map_len = 0;
     
-    /* We'll store each request line in the trace in this array */
-    if ((trace->ops = 
-	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-	unix_error("malloc 2 failed in read_trace");
+	/* We'll store each request line in the trace in this array */
+	if ((trace->ops = 
+	     (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+	    unix_error("malloc 2 failed in read_trace");
+    }
 
     /* We'll keep an array of pointers to the allocated blocks here... */
     if ((trace->blocks = 
-	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+	 (char **)calloc(trace->num_ids, sizeof(char *))) == NULL)
 	unix_error("malloc 3 failed in read_trace");
 
     /* ... along with the corresponding byte sizes of each block */
@@ -515,37 +1330,27 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
 	unix_error("malloc 4 failed in read_trace");
     
-    /* read every request line in the trace file */
-    index = 0;
+    if (trace->map != NULL) {
+	fclose(tracefile);
+	return trace;
+    }
+
+    /* read every request line in the trace file (the first is what
+     * is left of the header's last line) */
     op_index = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
-	switch(type[0]) {
-	case 'a':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = ALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'r':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = REALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'f':
-	    fscanf(tracefile, "%ud", &index);
-	    trace->ops[op_index].type = FREE;
-	    trace->ops[op_index].index = index;
-	    break;
-	default:
-	    printf("Bogus type character (%c) in tracefile %s\n", 
-		   type[0], path);
+    while (fgets(line, MAXLINE, tracefile) != NULL) {
+	if ((parsed = trace_parse_op(line, &op)) == 0)
+	    continue;
+	if (parsed < 0 || op_index == trace->num_ops || 
+	    !trace_op_ok(&op, trace->num_ids)) {
+	    line[strcspn(line, "\r\n")] = '\0';
+	    printf("Bogus request %u (%s) in tracefile %s\n", 
+		   op_index, line, path);
 	    exit(1);
 	}
-	op_index++;
-	
+	last = op.index + OP_IDS(&op) - 1;
+	max_index = (last > max_index) ? last : max_index;
+	trace->ops[op_index++] = op;
     }
     fclose(tracefile);
     assert(max_index == trace->num_ids - 1);
@@ -554,96 +1359,342 @@ static trace_t *read_trace(char *tracedir, char *filename)
     return trace;
 }
 
+/*
+ * map_trace - Map the binary tracefile open as tracefile, whose magic
+ *     number has already been read, and point trace->ops at its records.
+ */
+static void map_trace(trace_t *trace, FILE *tracefile, char *path)
+{
+    tracehdr_t *hdr;
+    struct stat st;
+    int i;
+
+    if (fstat(fileno(tracefile), &st) < 0)
+	unix_error("fstat failed in map_trace");
+    if (st.st_size < sizeof(tracehdr_t)) {
+	sprintf(msg, "Truncated binary trace header in %s", path);
+	app_error(msg);
+    }
+    trace->map_len = st.st_size;
+    trace->map = mmap(NULL, trace->map_len, PROT_READ, MAP_PRIVATE,
+		      fileno(tracefile), 0);
+    if (trace->map == MAP_FAILED)
+	unix_error("mmap failed in map_trace");
+
+    hdr = (tracehdr_t *)trace->map;
+    if (hdr->version != TRACE_VERSION || hdr->op_size != sizeof(traceop_t)) {
+	sprintf(msg, "Binary trace %s has version %u and %u-byte ops, "
+		"expected version %d and %d-byte ops", path, hdr->version,
+		hdr->op_size, TRACE_VERSION, (int)sizeof(traceop_t));
+	app_error(msg);
+    }
+    if (hdr->num_ops < 0 || hdr->num_ids < 0 ||
+	trace->map_len != sizeof(tracehdr_t) + 
+	(size_t)hdr->num_ops * sizeof(traceop_t)) {
+	sprintf(msg, "Binary trace %s does not hold %d ops", path, 
+		hdr->num_ops);
+	app_error(msg);
+    }
+    trace->sugg_heapsize = hdr->sugg_heapsize;
+    trace->num_ids = hdr->num_ids;
+    trace->num_ops = hdr->num_ops;
+    trace->weight = hdr->weight;
+    trace->ops = (traceop_t *)(hdr + 1);
+
+    /* Ids index the blocks arrays, so check them once up front */
+    for (i = 0; i < trace->num_ops; i++) {
+	if (!trace_op_ok(&trace->ops[i], trace->num_ids)) {
+	    sprintf(msg, "Bogus op %d (type %u, id %u) in binary trace %s",
+		    i, trace->ops[i].type, trace->ops[i].index, path);
+	    app_error(msg);
+	}
+    }
+}
+
 /*
  * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
+ *              to, all of which were allocated (or, for the ops of a
+ *              binary trace, mapped) in read_trace().
  */
 void free_trace(trace_t *trace)
 {
-    free(trace->ops);         /* free the three arrays... */
+    if (trace->map != NULL)   /* unmap or free the three arrays... */
+	munmap(trace->map, trace->map_len);
+    else
+	free(trace->ops);
     free(trace->blocks);      
     free(trace->block_sizes);
     free(trace);              /* and the trace record itself... */
 }
 
-/**********************************************************************
- * The following functions evaluate the correctness, space utilization,
- * and throughput of the libc and mm malloc packages.
- **********************************************************************/
+/*
+ * reset_heap - Start a replay of trace on an empty heap. Backends on
+ *    the memlib heap just reset it; the others are first handed back 
+ *    the blocks that the last replay of trace left allocated.
+ */
+static void reset_heap(trace_t *trace)
+{
+    int i;
+
+    if (!(mm->flags & ALLOC_HEAP))
+	for (i = 0; i < trace->num_ids; i++)
+	    if (trace->blocks[i] != NULL) {
+		mm->free(trace->blocks[i]);
+		trace->blocks[i] = NULL;
+	    }
+    mm->reset();
+}
+
+/*
+ * retire_blocks - Set aside the blocks array of the trace, with the
+ *    blocks that the last replay left allocated in a backend without
+ *    ALLOC_HEAP, and give the trace a fresh one. Unlike reset_heap it
+ *    takes the same time however many blocks were left, so it can run
+ *    in a timed replay; free_retired frees them after the timing.
+ */
+static void retire_blocks(speed_t *speed)
+{
+    trace_t *trace = speed->trace;
+
+    if (speed->num_retired == speed->max_retired) {
+	speed->max_retired = speed->max_retired ? 2 * speed->max_retired : 16;
+	if ((speed->retired = (char ***)realloc(speed->retired, 
+	     speed->max_retired * sizeof(char **))) == NULL)
+	    unix_error("realloc failed in retire_blocks");
+    }
+    speed->retired[speed->num_retired++] = trace->blocks;
+    if ((trace->blocks = 
+	 (char **)calloc(trace->num_ids, sizeof(char *))) == NULL)
+	unix_error("calloc failed in retire_blocks");
+}
+
+/*
+ * free_retired - Free the blocks left in the arrays set aside by
+ *    retire_blocks, and the arrays
+ */
+static void free_retired(speed_t *speed)
+{
+    int i, j;
+
+    for (i = 0; i < speed->num_retired; i++) {
+	for (j = 0; j < speed->trace->num_ids; j++)
+	    if (speed->retired[i][j] != NULL)
+		mm->free(speed->retired[i][j]);
+	free(speed->retired[i]);
+    }
+    speed->num_retired = 0;
+}
 
 /*
- * eval_mm_valid - Check the mm malloc package for correctness
+ * alloc_op - Make the call that an ALLOC, CALLOC or MEMALIGN op stands
+ *    for. A backend without calloc gets malloc and memset.
+ */
+static char *alloc_op(traceop_t *op)
+{
+    char *p;
+
+    switch (op->type) {
+    case CALLOC:
+	if (mm->calloc != NULL)
+	    return mm->calloc(op->aux, op->size);
+	if ((p = mm->malloc(OP_PAYLOAD(op))) != NULL)
+	    memset(p, 0, OP_PAYLOAD(op));
+	return p;
+    case MEMALIGN:
+	return (mm->memalign != NULL) ? mm->memalign(op->aux, op->size) : NULL;
+    default:
+	return mm->malloc(op->size);
+    }
+}
+
+/*
+ * free_op - Free p for a FREE or SIZED_FREE op, by a sized free if the
+ *    backend has one
+ */
+static void free_op(traceop_t *op, char *p)
+{
+    if (op->type == SIZED_FREE && mm->free_sized != NULL)
+	mm->free_sized(p, op->size);
+    else
+	mm->free(p);
+}
+
+/*
+ * batch_op - Make the call of a BATCH_ALLOC or BATCH_FREE op on the
+ *    blocks of its ids in trace->blocks, or one call per block if the 
+ *    backend has no batch call. Returns the blocks allocated or freed.
+ */
+static int batch_op(trace_t *trace, traceop_t *op)
+{
+    char **blocks = &trace->blocks[op->index];
+    int i, n = op->aux;
+
+    if (op->type == BATCH_FREE) {
+	if (mm->free_batch != NULL)
+	    mm->free_batch((void **)blocks, n);
+	else
+	    for (i = 0; i < n; i++)
+		mm->free(blocks[i]);
+	memset(blocks, 0, n * sizeof(char *));
+	return n;
+    }
+    if (mm->malloc_batch != NULL)
+	return mm->malloc_batch(op->size, n, (void **)blocks);
+    for (i = 0; i < n && (blocks[i] = mm->malloc(op->size)) != NULL; i++)
+	;
+    return i;
+}
+
+/*
+ * trace_path - Copy pattern to path, replacing "%t" with the name of
+ *    tracefile without its directory and suffix
+ */
+static void trace_path(char *path, char *pattern, char *tracefile)
+{
+    char name[MAXLINE], *p;
+
+    strcpy(name, BASENAME(tracefile));
+    if ((p = strrchr(name, '.')) != NULL)
+	*p = '\0';
+    if ((p = strstr(pattern, "%t")) != NULL)
+	sprintf(path, "%.*s%s%s", (int)(p - pattern), pattern, name, p + 2);
+    else
+	strcpy(path, pattern);
+}
+
+/**********************************************************************
+ * The following functions evaluate the correctness, space utilization,
+ * and throughput of the libc and mm malloc packages.
+ **********************************************************************/
+
+/*
+ * eval_mm_valid - Check the mm malloc package for correctness. With -F,
+ *    payloads are filled and checked only in part (see fill_payload),
+ *    and the ends of every block are also checked when it is freed.
  */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) 
 {
     int i, j;
     int index;
-    int size;
-    int oldsize;
+    size_t size;
+    size_t oldsize;
     char *newp;
     char *oldp;
     char *p;
+    traceop_t *op;
+    unsigned long long *keys = NULL; /* key of each block's fill (-F) */
+    unsigned long long fills = 0;    /* payloads filled so far (-F) */
     
-    /* Reset the heap and free any records in the range list */
-    mem_reset_brk();
+    /* Reset the heap and free any records in the range tree, and start
+     * the treap priorities over from the seed (never 0 for xorshift) */
+    reset_heap(trace);
     clear_ranges(ranges);
+    range_state = (unsigned int)payload_key(seed) | 1;
+    if (fast_check && (keys = (unsigned long long *)
+		       calloc(trace->num_ids, sizeof(*keys))) == NULL)
+	unix_error("calloc failed in eval_mm_valid");
 
     /* Call the mm package's init function */
-    if (mm_init() < 0) {
+    if (mm->init() < 0) {
 	malloc_error(tracenum, 0, "mm_init failed.");
+	free(keys);
 	return 0;
     }
 
+/* Return from eval_mm_valid */
+#define VALID_RETURN(v) do { free(keys); return (v); } while (0)
+
+/* Fill the payload of block index with a new key, or the low byte of index */
+#define FILL_PAYLOAD(p, index, size) do { \
+    if (fast_check) { \
+	keys[index] = payload_key(seed * PAYLOAD_STEP + ++fills); \
+	fill_payload((p), (size), keys[index], 0, 0); \
+    } \
+    else \
+	memset((p), (index) & 0xFF, (size)); } while (0)
+
     /* Interpret each operation in the trace in order */
     for (i = 0;  i < trace->num_ops;  i++) {
-	index = trace->ops[i].index;
-	size = trace->ops[i].size;
+	op = &trace->ops[i];
+	index = op->index;
+	size = OP_PAYLOAD(op);
 
-        switch (trace->ops[i].type) {
+        switch (op->type) {
 
         case ALLOC: /* mm_malloc */
+        case CALLOC: /* mm_calloc */
+        case MEMALIGN: /* mm_memalign */
 
 	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
-		malloc_error(tracenum, i, "mm_malloc failed.");
-		return 0;
+	    if ((p = alloc_op(op)) == NULL) {
+		malloc_error(tracenum, i, (op->type == ALLOC) ? 
+			     "mm_malloc failed." : (op->type == CALLOC) ? 
+			     "mm_calloc failed." : "mm_memalign failed.");
+		VALID_RETURN(0);
+	    }
+	    if (op->type == MEMALIGN && (size_t)p % op->aux != 0) {
+		sprintf(msg, "mm_memalign returned a block that is not "
+			"aligned to %u bytes.", op->aux);
+		malloc_error(tracenum, i, msg);
+		VALID_RETURN(0);
 	    }
 	    
 	    /* 
 	     * Test the range of the new block for correctness and add it 
-	     * to the range list if OK. The block must be  be aligned properly,
+	     * to the range tree if OK. The block must be  be aligned properly,
 	     * and must not overlap any currently allocated block. 
 	     */ 
 	    if (add_range(ranges, p, size, tracenum, i) == 0)
-		return 0;
+		VALID_RETURN(0);
+	    if (op->type == CALLOC && !check_zero(p, size)) {
+		malloc_error(tracenum, i, "mm_calloc did not clear the block.");
+		VALID_RETURN(0);
+	    }
 	    
 	    /* ADDED: cgw
 	     * fill range with low byte of index.  This will be used later
 	     * if we realloc the block and wish to make sure that the old
 	     * data was copied to the new block
 	     */
-	    memset(p, index & 0xFF, size);
+	    FILL_PAYLOAD(p, index, size);
 
 	    /* Remember region */
 	    trace->blocks[index] = p;
 	    trace->block_sizes[index] = size;
 	    break;
 
+        case BATCH_ALLOC: /* mm_malloc_batch */
+
+	    /* The blocks of ids index.. are checked and filled like those 
+	     * of single mallocs */
+	    if (batch_op(trace, op) != op->aux) {
+		malloc_error(tracenum, i, "mm_malloc_batch failed.");
+		VALID_RETURN(0);
+	    }
+	    for (j = index; j < index + op->aux; j++) {
+		p = trace->blocks[j];
+		if (add_range(ranges, p, size, tracenum, i) == 0)
+		    VALID_RETURN(0);
+		FILL_PAYLOAD(p, j, size);
+		trace->block_sizes[j] = size;
+	    }
+	    break;
+
         case REALLOC: /* mm_realloc */
 	    
 	    /* Call the student's realloc */
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp, size)) == NULL) {
+	    if ((newp = mm->realloc(oldp, size)) == NULL) {
 		malloc_error(tracenum, i, "mm_realloc failed.");
-		return 0;
+		VALID_RETURN(0);
 	    }
 	    
-	    /* Remove the old region from the range list */
+	    /* Remove the old region from the range tree */
 	    remove_range(ranges, oldp);
 	    
-	    /* Check new block for correctness and add it to range list */
+	    /* Check new block for correctness and add it to range tree */
 	    if (add_range(ranges, newp, size, tracenum, i) == 0)
-		return 0;
+		VALID_RETURN(0);
 	    
 	    /* ADDED: cgw
 	     * Make sure that the new block contains the data from the old 
@@ -652,14 +1703,15 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	     */
 	    oldsize = trace->block_sizes[index];
 	    if (size < oldsize) oldsize = size;
-	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
+	    if (fast_check ? 
+		!fill_payload(newp, trace->block_sizes[index], keys[index], 
+			      oldsize, 1) :
+		!check_bytes(newp, oldsize, index & 0xFF)) {
 		malloc_error(tracenum, i, "mm_realloc did not preserve the "
 			     "data from old block");
-		return 0;
-	      }
+		VALID_RETURN(0);
 	    }
-	    memset(newp, index & 0xFF, size);
+	    FILL_PAYLOAD(newp, index, size);
 
 	    /* Remember region */
 	    trace->blocks[index] = newp;
@@ -667,11 +1719,26 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    break;
 
         case FREE: /* mm_free */
+        case SIZED_FREE: /* mm_free_sized */
+        case BATCH_FREE: /* mm_free_batch */
 	    
-	    /* Remove region from list and call student's free function */
-	    p = trace->blocks[index];
-	    remove_range(ranges, p);
-	    mm_free(p);
+	    /* Remove the regions from list and call student's free function */
+	    for (j = index; j < index + OP_IDS(op); j++) {
+		p = trace->blocks[j];
+		if (fast_check && !check_ends(p, trace->block_sizes[j], 
+					      keys[j])) {
+		    malloc_error(tracenum, i, "payload was overwritten before "
+				 "mm_free");
+		    VALID_RETURN(0);
+		}
+		remove_range(ranges, p);
+	    }
+	    if (op->type == BATCH_FREE)
+		batch_op(trace, op);
+	    else {
+		free_op(op, trace->blocks[index]);
+		trace->blocks[index] = NULL;
+	    }
 	    break;
 
 	default:
@@ -679,8 +1746,11 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
         }
 
     }
+#undef FILL_PAYLOAD
+#undef VALID_RETURN
 
     /* As far as we know, this is a valid malloc package */
+    free(keys);
     return 1;
 }
 
@@ -693,31 +1763,46 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   package on the trace. Note that our implementation of mem_sbrk() 
  *   doesn't allow the students to decrement the brk pointer, so brk
  *   is always the high water mark of the heap. 
- *   
+ *
+ *   With -U or -u, it also samples the heap size, the live payload and
+ *   mm.c's free lists every num_ops/timeline_points requests into 
+ *   stats->timeline, to show when and why the ratio drops. If layout
+ *   is not NULL, the heap is written to it by mm_dump_layout right 
+ *   after the request at which the live payload peaks (-Y).
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   stats_t *stats, char *layout)
 {   
-    int i;
+    int i, j, interval = 0, snapshot = -1;
     int index;
-    int size, newsize, oldsize;
-    int max_total_size = 0;
-    int total_size = 0;
+    size_t size, newsize, oldsize;
+    size_t max_total_size = 0;
+    size_t total_size = 0;
     char *p;
     char *newp, *oldp;
+    traceop_t *op;
 
     /* initialize the heap and the mm malloc package */
-    mem_reset_brk();
-    if (mm_init() < 0)
+    reset_heap(trace);
+    if (mm->init() < 0)
 	app_error("mm_init failed in eval_mm_util");
+    stats->num_samples = 0;
+    if (timeline_points > 0 && (mm->flags & ALLOC_HEAP))
+	interval = (trace->num_ops + timeline_points - 1) / timeline_points;
+    if (layout != NULL)
+	snapshot = peak_op(trace);
 
     for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
+	op = &trace->ops[i];
+        switch (op->type) {
 
         case ALLOC: /* mm_alloc */
-	    index = trace->ops[i].index;
-	    size = trace->ops[i].size;
+        case CALLOC: /* mm_calloc */
+        case MEMALIGN: /* mm_memalign */
+	    index = op->index;
+	    size = OP_PAYLOAD(op);
 
-	    if ((p = mm_malloc(size)) == NULL) 
+	    if ((p = alloc_op(op)) == NULL) 
 		app_error("mm_malloc failed in eval_mm_util");
 	    
 	    /* Remember region and size */
@@ -733,13 +1818,23 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 		total_size : max_total_size;
 	    break;
 
+        case BATCH_ALLOC: /* mm_malloc_batch */
+	    if (batch_op(trace, op) != op->aux)
+		app_error("mm_malloc_batch failed in eval_mm_util");
+	    for (j = op->index; j < op->index + op->aux; j++)
+		trace->block_sizes[j] = op->size;
+	    total_size += op->aux * op->size;
+	    max_total_size = (total_size > max_total_size) ?
+		total_size : max_total_size;
+	    break;
+
 	case REALLOC: /* mm_realloc */
 	    index = trace->ops[i].index;
 	    newsize = trace->ops[i].size;
 	    oldsize = trace->block_sizes[index];
 
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp,newsize)) == NULL)
+	    if ((newp = mm->realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc failed in eval_mm_util");
 
 	    /* Remember region and size */
@@ -756,11 +1851,13 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    break;
 
         case FREE: /* mm_free */
+        case SIZED_FREE: /* mm_free_sized */
 	    index = trace->ops[i].index;
 	    size = trace->block_sizes[index];
 	    p = trace->blocks[index];
 	    
-	    mm_free(p);
+	    free_op(op, p);
+	    trace->blocks[index] = NULL;
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -768,15 +1865,86 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    break;
 
+        case BATCH_FREE: /* mm_free_batch */
+	    for (j = op->index; j < op->index + op->aux; j++)
+		total_size -= trace->block_sizes[j];
+	    batch_op(trace, op);
+	    break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_util");
 
         }
+
+	/* Sample the heap after every interval requests and the last */
+	if (interval > 0 && 
+	    ((i + 1) % interval == 0 || i == trace->num_ops - 1)) {
+	    sample_t *sample = &stats->timeline[stats->num_samples++];
+	    mm_stats_t events;
+
+	    mm->get_stats(&events);
+	    sample->op = i + 1;
+	    sample->heap = mem_heapsize();
+	    sample->live = total_size;
+	    sample->peak = max_total_size;
+	    sample->free_bytes = events.free_bytes;
+	    sample->free_blocks = events.free_blocks;
+	}
+
+	if (i == snapshot) {
+	    FILE *fp;
+
+	    if ((fp = fopen(layout, "w")) == NULL) {
+		sprintf(msg, "Could not open %s in eval_mm_util", layout);
+		unix_error(msg);
+	    }
+	    if (mm->dump_layout(fp) < 0 || fclose(fp) != 0) {
+		sprintf(msg, "Could not write %s in eval_mm_util", layout);
+		unix_error(msg);
+	    }
+	}
     }
 
+    /* The heap of other backends is not ours to measure */
+    if (!(mm->flags & ALLOC_HEAP))
+	return 0;
     return ((double)max_total_size / (double)mem_heapsize());
 }
 
+/*
+ * peak_op - Return the request of trace after which the total payload
+ *    of the live blocks is largest (the first, if it peaks more than once)
+ */
+static int peak_op(trace_t *trace)
+{
+    int i, j, peak = 0;
+    size_t total = 0, max_total = 0;
+    size_t *sizes;
+    traceop_t *op;
+
+    if ((sizes = (size_t *)calloc(trace->num_ids, sizeof(size_t))) == NULL)
+	unix_error("calloc failed in peak_op");
+    for (i = 0; i < trace->num_ops; i++) {
+	op = &trace->ops[i];
+	for (j = op->index; j < op->index + OP_IDS(op); j++) {
+	    if (op->type == FREE || op->type == SIZED_FREE || 
+		op->type == BATCH_FREE) {
+		total -= sizes[j];
+		sizes[j] = 0;
+	    }
+	    else {
+		total += OP_PAYLOAD(op) - sizes[j];
+		sizes[j] = OP_PAYLOAD(op);
+	    }
+	}
+	if (total > max_total) {
+	    max_total = total;
+	    peak = i;
+	}
+    }
+    free(sizes);
+    return peak;
+}
 
 /*
  * eval_mm_speed - This is the function that is used by fcyc()
@@ -784,13 +1952,18 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
+    int i, index;
+    size_t size, newsize;
     char *p, *newp, *oldp, *block;
-    trace_t *trace = ((speed_t *)ptr)->trace;
-
-    /* Reset the heap and initialize the mm package */
-    mem_reset_brk();
-    if (mm_init() < 0) 
+    speed_t *speed = (speed_t *)ptr;
+    trace_t *trace = speed->trace;
+
+    /* Reset the heap and initialize the mm package. What the last 
+       replay left allocated is freed after the timing, not here */
+    if (!(mm->flags & ALLOC_HEAP))
+	retire_blocks(speed);
+    mm->reset();
+    if (mm->init() < 0) 
 	app_error("mm_init failed in eval_mm_speed");
 
     /* Interpret each trace request */
@@ -800,7 +1973,7 @@ static void eval_mm_speed(void *ptr)
         case ALLOC: /* mm_malloc */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
+            if ((p = mm->malloc(size)) == NULL)
 		app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
             break;
@@ -809,7 +1982,7 @@ static void eval_mm_speed(void *ptr)
 	    index = trace->ops[i].index;
             newsize = trace->ops[i].size;
 	    oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL)
+            if ((newp = mm->realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc error in eval_mm_speed");
             trace->blocks[index] = newp;
             break;
@@ -817,7 +1990,27 @@ static void eval_mm_speed(void *ptr)
         case FREE: /* mm_free */
             index = trace->ops[i].index;
             block = trace->blocks[index];
-            mm_free(block);
+            mm->free(block);
+            trace->blocks[index] = NULL;
+            break;
+
+        case CALLOC: /* mm_calloc */
+        case MEMALIGN: /* mm_memalign */
+            if ((p = alloc_op(&trace->ops[i])) == NULL)
+		app_error("mm_calloc or mm_memalign error in eval_mm_speed");
+            trace->blocks[trace->ops[i].index] = p;
+            break;
+
+        case SIZED_FREE: /* mm_free_sized */
+            index = trace->ops[i].index;
+            free_op(&trace->ops[i], trace->blocks[index]);
+            trace->blocks[index] = NULL;
+            break;
+
+        case BATCH_ALLOC: /* mm_malloc_batch */
+        case BATCH_FREE: /* mm_free_batch */
+            if (batch_op(trace, &trace->ops[i]) != trace->ops[i].aux)
+		app_error("mm_malloc_batch error in eval_mm_speed");
             break;
 
 	default:
@@ -826,88 +2019,811 @@ static void eval_mm_speed(void *ptr)
 }
 
 /*
- * eval_libc_valid - We run this function to make sure that the
- *    libc malloc can run to completion on the set of traces.
- *    We'll be conservative and terminate if any libc malloc call fails.
- *
+ * eval_mm_latency - Replay the trace LATENCY_RUNS times, timing every
+ *    mm call with lathist_now() and counting the latencies in lat[], 
+ *    by op type. The cost of reading the timer is subtracted. If best 
+ *    is not NULL, best[i] is set to the fewest ticks of op i in any run.
+ */
+static void eval_mm_latency(trace_t *trace, lathist_t *lat, lattick_t *best)
+{
+    int i, n, run, index;
+    char *p;
+    lattick_t start, end, overhead, t;
+    traceop_t *op;
+
+    /* Overhead of a pair of timer reads: the fastest of many */
+    overhead = ~(lattick_t)0;
+    for (i = 0; i < 100; i++) {
+	start = lathist_now();
+	end = lathist_now();
+	if (end - start < overhead)
+	    overhead = end - start;
+    }
+
+    for (i = 0; i < NUM_OP_TYPES; i++)
+	lathist_clear(&lat[i]);
+    for (i = 0; best != NULL && i < trace->num_ops; i++)
+	best[i] = ~(lattick_t)0;
+    for (run = 0; run < LATENCY_RUNS; run++) {
+	reset_heap(trace);
+	if (mm->init() < 0) 
+	    app_error("mm_init failed in eval_mm_latency");
+
+	for (i = 0;  i < trace->num_ops;  i++) {
+	    op = &trace->ops[i];
+	    index = op->index;
+	    switch (op->type) {
+
+	    case ALLOC: /* mm_malloc */
+		start = lathist_now();
+		p = mm->malloc(op->size);
+		end = lathist_now();
+		if (p == NULL)
+		    app_error("mm_malloc error in eval_mm_latency");
+		trace->blocks[index] = p;
+		break;
+
+	    case CALLOC: /* mm_calloc */
+	    case MEMALIGN: /* mm_memalign */
+		start = lathist_now();
+		p = alloc_op(op);
+		end = lathist_now();
+		if (p == NULL)
+		    app_error("mm_calloc or mm_memalign error in "
+			      "eval_mm_latency");
+		trace->blocks[index] = p;
+		break;
+
+	    case BATCH_ALLOC: /* mm_malloc_batch, timed as one call */
+	    case BATCH_FREE: /* mm_free_batch */
+		start = lathist_now();
+		n = batch_op(trace, op);
+		end = lathist_now();
+		if (n != op->aux)
+		    app_error("mm_malloc_batch error in eval_mm_latency");
+		break;
+
+	    case REALLOC: /* mm_realloc */
+		start = lathist_now();
+		p = mm->realloc(trace->blocks[index], op->size);
+		end = lathist_now();
+		if (p == NULL)
+		    app_error("mm_realloc error in eval_mm_latency");
+		trace->blocks[index] = p;
+		break;
+
+	    case FREE: /* mm_free */
+	    case SIZED_FREE: /* mm_free_sized */
+		start = lathist_now();
+		free_op(op, trace->blocks[index]);
+		end = lathist_now();
+		trace->blocks[index] = NULL;
+		break;
+
+	    default:
+		app_error("Nonexistent request type in eval_mm_latency");
+	    }
+	    t = (end - start > overhead) ? end - start - overhead : 0;
+	    lathist_record(&lat[op->type], t);
+	    if (best != NULL && t < best[i])
+		best[i] = t;
+	}
+    }
+}
+
+/*
+ * eval_mm_locality - Replay the trace once on the address-traced build
+ *    of the current mm package (see addrtrace.h), counting the heap 
+ *    words it reads and writes, and the lookups that miss in the 
+ *    simulated cache (-S). The accesses are written to the lackey file,
+ *    if any (-L). With -D, the application's accesses are traced too:
+ *    it writes each payload when it is allocated, and the bytes that a
+ *    realloc adds. Backends other than mm.c have no traced build, so 
+ *    only their payload accesses can be traced.
  */
-static int eval_libc_valid(trace_t *trace, int tracenum)
+static void eval_mm_locality(trace_t *trace, char *tracefile, 
+			     addrcount_t *count)
 {
-    int i, newsize;
-    char *p, *newp, *oldp;
+    int i, j, index;
+    size_t size, oldsize;
+    char *p, *path = NULL, file[MAXLINE];
+    allocator_t *under_test = mm;
+    traceop_t *op;
+
+    memset(count, 0, sizeof(*count));
+    reset_heap(trace);
+    for (i = 0; mm_variants[i].name != NULL; i++)
+	if (mm == &mm_variants[i])
+	    mm = &mm_traced_variants[i];
+    if (mm == under_test && !trace_payload) 
+	return; /* nothing to trace */
+
+    if (lackey_file != NULL) {
+	path = file;
+	trace_path(path, lackey_file, tracefile);
+    }
+    if (addrtrace_start(path) < 0) {
+	if (path != NULL)
+	    snprintf(msg, sizeof(msg), "Could not open %.900s in eval_mm_locality",
+		     path);
+	else
+	    snprintf(msg, sizeof(msg),
+		     "Could not set up the simulated cache in eval_mm_locality");
+	unix_error(msg);
+    }
 
+    mm->reset();
+    if (mm->init() < 0) 
+	app_error("mm_init failed in eval_mm_locality");
     for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
+	op = &trace->ops[i];
+	index = op->index;
+	size = OP_PAYLOAD(op);
+	switch (op->type) {
+
+	case ALLOC: /* mm_malloc */
+	case CALLOC: /* mm_calloc */
+	case MEMALIGN: /* mm_memalign */
+	    if ((p = alloc_op(op)) == NULL)
+		app_error("mm_malloc error in eval_mm_locality");
+	    if (trace_payload)
+		addrtrace_range(p, size, 1);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    break;
 
-        case ALLOC: /* malloc */
-	    if ((p = malloc(trace->ops[i].size)) == NULL) {
-		malloc_error(tracenum, i, "libc malloc failed");
-		unix_error("System message");
+	case BATCH_ALLOC: /* mm_malloc_batch */
+	    if (batch_op(trace, op) != op->aux)
+		app_error("mm_malloc_batch error in eval_mm_locality");
+	    for (j = index; j < index + op->aux; j++) {
+		if (trace_payload)
+		    addrtrace_range(trace->blocks[j], size, 1);
+		trace->block_sizes[j] = size;
 	    }
-	    trace->blocks[trace->ops[i].index] = p;
 	    break;
 
-	case REALLOC: /* realloc */
-            newsize = trace->ops[i].size;
-	    oldp = trace->blocks[trace->ops[i].index];
-	    if ((newp = realloc(oldp, newsize)) == NULL) {
-		malloc_error(tracenum, i, "libc realloc failed");
-		unix_error("System message");
-	    }
-	    trace->blocks[trace->ops[i].index] = newp;
+	case REALLOC: /* mm_realloc */
+	    oldsize = trace->block_sizes[index];
+	    if ((p = mm->realloc(trace->blocks[index], size)) == NULL)
+		app_error("mm_realloc error in eval_mm_locality");
+	    if (trace_payload && size > oldsize)
+		addrtrace_range(p + oldsize, size - oldsize, 1);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
 	    break;
-	    
-        case FREE: /* free */
-	    free(trace->blocks[trace->ops[i].index]);
+
+	case FREE: /* mm_free */
+	case SIZED_FREE: /* mm_free_sized */
+	    free_op(op, trace->blocks[index]);
+	    trace->blocks[index] = NULL;
+	    break;
+
+	case BATCH_FREE: /* mm_free_batch */
+	    batch_op(trace, op);
 	    break;
 
 	default:
-	    app_error("invalid operation type  in eval_libc_valid");
+	    app_error("Nonexistent request type in eval_mm_locality");
 	}
     }
+    addrtrace_stop(count);
+    mm = under_test;
+}
 
-    return 1;
+/*
+ * eval_mm_trace - Evaluate the current mm package (correctness,
+ *    utilization and speed) on one tracefile, filling in *stats
+ */
+static void eval_mm_trace(char *tracefile, int tracenum, stats_t *stats,
+			  range_t **ranges)
+{
+    trace_t *trace;
+    speed_t speed_params;
+    char layout[MAXLINE];
+
+    trace = read_trace(tracedir, tracefile);
+    stats->ops = trace->num_ops;
+    if (verbose > 1)
+	printf("Checking mm_malloc for correctness, ");
+    stats->valid = eval_mm_valid(trace, tracenum, ranges);
+    if (stats->valid) {
+	if (verbose > 1)
+	    printf("efficiency, ");
+	if (layout_file != NULL && mm->dump_layout != NULL)
+	    trace_path(layout, layout_file, tracefile);
+	else
+	    layout[0] = '\0';
+	stats->util = eval_mm_util(trace, tracenum, ranges, stats, 
+				   layout[0] ? layout : NULL);
+	mm->get_stats(&stats->events);
+	speed_params.trace = trace;
+	speed_params.ranges = *ranges;
+	speed_params.retired = NULL;
+	speed_params.num_retired = speed_params.max_retired = 0;
+	if (verbose > 1)
+	    printf("and performance.\n");
+	stats->secs = fsecs(eval_mm_speed, &speed_params);
+	free_retired(&speed_params);
+	if (repeats > 1) {
+	    double secs, sum = 0, sumsq = 0, mean;
+	    int r;
+
+	    /* Keep the fastest timing; its spread is the noise */
+	    for (r = 0; r < repeats; r++) {
+		if (r > 0) {
+		    secs = fsecs(eval_mm_speed, &speed_params);
+		    free_retired(&speed_params);
+		} else
+		    secs = stats->secs;
+		sum += secs;
+		sumsq += secs * secs;
+		stats->secs = (secs < stats->secs) ? secs : stats->secs;
+	    }
+	    mean = sum / repeats;
+	    stats->noise = sqrt(fmax(sumsq / repeats - mean * mean, 0) * 
+				repeats / (repeats - 1)) / mean;
+	}
+	if (count_events) {
+	    fsecs_count(eval_mm_speed, &speed_params, &stats->perf);
+	    free_retired(&speed_params);
+	}
+	free(speed_params.retired);
+	if (latency || optime_file != NULL) {
+	    lattick_t *best = NULL;
+	    char path[MAXLINE];
+
+	    if (optime_file != NULL && (best = (lattick_t *)
+		malloc(trace->num_ops * sizeof(lattick_t))) == NULL)
+		unix_error("malloc failed in eval_mm_trace");
+	    eval_mm_latency(trace, stats->lat, best);
+	    if (best != NULL) {
+		trace_path(path, optime_file, tracefile);
+		writeoptimes(path, trace, best);
+		free(best);
+	    }
+	}
+	if (locality)
+	    eval_mm_locality(trace, tracefile, &stats->cache);
+    }
+    free_trace(trace);
 }
 
-/* 
- * eval_libc_speed - This is the function that is used by fcyc() to
- *    measure the running time of the libc malloc package on the set
- *    of traces.
+/*
+ * eval_mm_package - Evaluate the current mm package on every 
+ *    tracefile, filling in stats[]
  */
-static void eval_libc_speed(void *ptr)
+static void eval_mm_package(int num_tracefiles, char **tracefiles, 
+			    stats_t *stats, range_t **ranges)
 {
     int i;
-    int index, size, newsize;
-    char *p, *newp, *oldp, *block;
-    trace_t *trace = ((speed_t *)ptr)->trace;
 
-    for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
-        case ALLOC: /* malloc */
-	    index = trace->ops[i].index;
-	    size = trace->ops[i].size;
-	    if ((p = malloc(size)) == NULL)
-		unix_error("malloc failed in eval_libc_speed");
-	    trace->blocks[index] = p;
+    if (jobs > 1) {
+	eval_mm_parallel(num_tracefiles, tracefiles, stats, ranges);
+	return;
+    }
+    for (i=0; i < num_tracefiles; i++)
+	eval_mm_trace(tracefiles[i], i, &stats[i], ranges);
+}
+
+/*
+ * eval_mm_parallel - Like eval_mm_package, but evaluate up to jobs 
+ *    traces at once. Each trace runs in a forked worker process, which 
+ *    has its own copy of the simulated heap and of mm.c's globals, and
+ *    sends its stats and error count back over a pipe. A worker that 
+ *    dies without reporting (e.g. a segfault in mm.c) marks its trace
+ *    invalid. Note that concurrent workers share the CPU caches and 
+ *    memory bandwidth, so throughput is noisier than with -j 1.
+ */
+static void eval_mm_parallel(int num_tracefiles, char **tracefiles, 
+			     stats_t *stats, range_t **ranges)
+{
+    pid_t *pids;
+    struct pollfd *fds;
+    int *slots;
+    char *busy;
+    int i, slot, next, running, status, fd[2];
+    size_t got;
+    ssize_t n;
+    pid_t pid;
+    result_t result;
+
+    if ((pids = (pid_t *)calloc(num_tracefiles, sizeof(pid_t))) == NULL ||
+	(fds = (struct pollfd *)calloc(num_tracefiles, 
+				       sizeof(struct pollfd))) == NULL ||
+	(slots = (int *)calloc(num_tracefiles, sizeof(int))) == NULL ||
+	(busy = (char *)calloc(jobs, 1)) == NULL)
+	unix_error("calloc failed in eval_mm_parallel");
+
+    for (next = running = 0; next < num_tracefiles || running > 0; ) {
+	/* Start workers until jobs are running or every trace has one */
+	if (next < num_tracefiles && running < jobs) {
+	    if (pipe(fd) < 0)
+		unix_error("pipe failed in eval_mm_parallel");
+	    for (slot = 0; busy[slot]; slot++)
+		;
+	    fflush(stdout);
+	    if ((pid = fork()) < 0)
+		unix_error("fork failed in eval_mm_parallel");
+	    if (pid == 0) {  /* worker, on a CPU of its own with -C */
+		close(fd[0]);
+		fsecs_pin_job(slot);
+		errors = 0;
+		memset(&result, 0, sizeof(result));
+		eval_mm_trace(tracefiles[next], next, &result.stats, ranges);
+		result.errors = errors;
+		if (write(fd[1], &result, sizeof(result)) != sizeof(result))
+		    unix_error("write failed in eval_mm_parallel");
+		exit(0);
+	    }
+	    close(fd[1]);
+	    pids[next] = pid;
+	    fds[next].fd = fd[0];
+	    fds[next].events = POLLIN;
+	    slots[next] = slot;
+	    busy[slot] = 1;
+	    next++;
+	    running++;
+	    continue;
+	}
+
+	/* Collect the next worker to finish. Its result is larger than a 
+	 * pipe holds, so it is read as the worker writes it, before the 
+	 * worker can exit and be reaped */
+	if (poll(fds, next, -1) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    unix_error("poll failed in eval_mm_parallel");
+	}
+	for (i = 0; i < next && fds[i].revents == 0; i++)
+	    ;
+	if (i == next)
+	    continue;
+	for (got = 0; got < sizeof(result); got += n)
+	    if ((n = read(fds[i].fd, (char *)&result + got, 
+			  sizeof(result) - got)) <= 0)
+		break;
+	if (waitpid(pids[i], &status, 0) < 0)
+	    unix_error("waitpid failed in eval_mm_parallel");
+	running--;
+	busy[slots[i]] = 0;
+	if (got == sizeof(result)) {
+	    stats[i] = result.stats;
+	    errors += result.errors;
+	}
+	else {
+	    errors++;
+	    printf("ERROR [trace %d]: Worker died (%s %d)\n", i,
+		   WIFSIGNALED(status) ? "signal" : "exit status",
+		   WIFSIGNALED(status) ? WTERMSIG(status) : 
+		   WEXITSTATUS(status));
+	    stats[i].valid = 0;
+	}
+	close(fds[i].fd);
+	fds[i].fd = -1;  /* poll skips it */
+    }
+    free(pids);
+    free(fds);
+    free(slots);
+    free(busy);
+}
+
+/*
+ * eval_mm_stream - Replay one tracefile through the mm package as a 
+ *    trace_stream_t reads it, tracking the live blocks in an idmap. This is 
+ *    timed by ftimer_gettod, so the replay does no correctness checks;
+ *    it only measures the peak payload for the utilization.
+ */
+static void eval_mm_stream(void *ptr)
+{
+    stream_params_t *params = (stream_params_t *)ptr;
+    idmap_t *live = params->live;
+    idslot_t *slot;
+    trace_stream_t *stream;
+    traceop_t *ops, *op;
+    int i, j, n, opnum;
+    char *p, **blocks;
+    double total_size = 0, max_total_size = 0;
+
+    /* Reset the heap and initialize the mm package */
+    mm->reset();
+    if (mm->init() < 0) 
+	app_error("mm_init failed in eval_mm_stream");
+
+    stream = stream_open(params->path);
+    params->valid = 1;
+    opnum = 0;
+    while ((n = stream_next(stream, &ops)) > 0) {
+	for (i = 0; i < n && params->valid; i++, opnum++) {
+	    op = &ops[i];
+	    switch (op->type) {
+
+	    case ALLOC: /* mm_malloc */
+	    case CALLOC: /* mm_calloc */
+	    case MEMALIGN: /* mm_memalign */
+		if ((p = alloc_op(op)) == NULL) {
+		    malloc_error(params->tracenum, opnum, "mm_malloc failed.");
+		    params->valid = 0;
+		    break;
+		}
+		slot = idmap_insert(live, op->index);
+		slot->block = p;
+		slot->size = OP_PAYLOAD(op);
+		total_size += OP_PAYLOAD(op);
+		break;
+
+	    case BATCH_ALLOC: /* mm_malloc_batch */
+		if ((blocks = (char **)malloc(op->aux * sizeof(char *))) == NULL)
+		    unix_error("malloc failed in eval_mm_stream");
+		if (mm->malloc_batch != NULL)
+		    j = mm->malloc_batch(op->size, op->aux, (void **)blocks);
+		else
+		    for (j = 0; j < op->aux && 
+			     (blocks[j] = mm->malloc(op->size)) != NULL; j++)
+			;
+		if (j != op->aux) {
+		    malloc_error(params->tracenum, opnum, 
+				 "mm_malloc_batch failed.");
+		    params->valid = 0;
+		}
+		while (--j >= 0) {
+		    slot = idmap_insert(live, op->index + j);
+		    slot->block = blocks[j];
+		    slot->size = op->size;
+		    total_size += op->size;
+		}
+		free(blocks);
+		break;
+
+	    case REALLOC: /* mm_realloc */
+		if ((slot = idmap_find(live, ops[i].index)) == NULL) {
+		    malloc_error(params->tracenum, opnum, 
+				 "Realloc of an id that is not live.");
+		    params->valid = 0;
+		    break;
+		}
+		if ((p = mm->realloc(slot->block, ops[i].size)) == NULL) {
+		    malloc_error(params->tracenum, opnum, "mm_realloc failed.");
+		    params->valid = 0;
+		    break;
+		}
+		total_size += (double)ops[i].size - slot->size;
+		slot->block = p;
+		slot->size = ops[i].size;
+		break;
+
+	    case FREE: /* mm_free */
+	    case SIZED_FREE: /* mm_free_sized */
+	    case BATCH_FREE: /* mm_free_batch, one block at a time */
+		for (j = op->index; j < op->index + OP_IDS(op); j++) {
+		    if ((slot = idmap_find(live, j)) == NULL) {
+			malloc_error(params->tracenum, opnum, 
+				     "Free of an id that is not live.");
+			params->valid = 0;
+			break;
+		    }
+		    free_op(op, slot->block);
+		    total_size -= slot->size;
+		    idmap_remove(live, slot);
+		}
+		break;
+	    }
+	    max_total_size = (total_size > max_total_size) ?
+		total_size : max_total_size;
+	}
+	opnum += n - i;  /* ops skipped after a failure */
+    }
+    stream_close(stream);
+
+    /* Forget the blocks that the trace left live, or hand them back
+     * to a backend that does not allocate from the memlib heap */
+    for (i = 0; i <= live->mask; i++) {
+	if (live->slots[i].id != IDMAP_EMPTY && !(mm->flags & ALLOC_HEAP))
+	    mm->free(live->slots[i].block);
+	live->slots[i].id = IDMAP_EMPTY;
+    }
+    live->count = 0;
+
+    params->ops = opnum;
+    params->util = (mm->flags & ALLOC_HEAP) ? 
+	max_total_size / (double)mem_heapsize() : 0;
+}
+
+/*
+ * eval_mm_streams - Stream every tracefile through the current mm 
+ *    package once, filling in stats[] without loading any trace
+ */
+static void eval_mm_streams(int num_tracefiles, char **tracefiles, 
+			    stats_t *stats)
+{
+    int i;
+    char path[MAXLINE];
+    stream_params_t params;
+    idmap_t live;
+
+    idmap_init(&live);
+    for (i=0; i < num_tracefiles; i++) {
+	if (verbose > 1)
+	    printf("Streaming tracefile: %s\n", tracefiles[i]);
+	strcpy(path, tracedir);
+	strcat(path, tracefiles[i]);
+	params.path = path;
+	params.tracenum = i;
+	params.live = &live;
+	stats[i].secs = ftimer_gettod(eval_mm_stream, &params, 1);
+	stats[i].ops = params.ops;
+	stats[i].util = params.util;
+	stats[i].valid = params.valid;
+	mm->get_stats(&stats[i].events);
+    }
+    free(live.slots);
+}
+
+/* Record the first error of a replay thread; malloc_error is not thread safe */
+#define REPLAY_ERROR(thr, i, m) do { \
+    if ((thr)->errors++ == 0) { \
+	(thr)->error_op = (thr)->ops[i]; \
+	(thr)->error_msg = (m); \
+    } \
+} while (0)
+
+/*
+ * replay_clock - Current time in seconds, for timing the replay threads
+ */
+static double replay_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1E-9*ts.tv_nsec;
+}
+
+/*
+ * replay_thread - Body of one thread of the threaded replay: run this
+ *    thread's ops in order, waiting for the ops on the same id that 
+ *    other threads must run first. The first word of each payload holds
+ *    its id, which catches blocks handed out twice at once.
+ */
+static void *replay_thread(void *arg)
+{
+    replay_thread_t *thr = (replay_thread_t *)arg;
+    trace_t *trace = thr->trace;
+    traceop_t *op;
+    int i, t, spins, id, slowest = 0;
+    size_t size;
+    char *p;
+
+    pthread_barrier_wait(thr->start);
+    thr->begin = replay_clock();
+
+    for (i = 0; i < thr->num_ops; i++) {
+	op = &trace->ops[thr->ops[i]];
+	id = op->index;
+	size = OP_PAYLOAD(op);
+
+	/* Wait until no thread is more than THREAD_WINDOW ops behind */
+	__atomic_store_n(&thr->progress[thr->self], thr->ops[i], 
+			 __ATOMIC_RELEASE);
+	for (spins = 0; thr->ops[i] - slowest > THREAD_WINDOW; spins++) {
+	    slowest = INT_MAX;
+	    for (t = 0; t < thr->nthreads; t++)
+		if (__atomic_load_n(&thr->progress[t], __ATOMIC_ACQUIRE) < slowest)
+		    slowest = thr->progress[t];
+	    if (spins >= 64)
+		sched_yield();
+	}
+
+	/* Wait for the earlier ops on this id */
+	for (spins = 0; 
+	     __atomic_load_n(&thr->seq[id], __ATOMIC_ACQUIRE) != thr->ords[i]; 
+	     spins++)
+	    if (spins >= 64)
+		sched_yield();
+
+	/* The payload must still hold its id */
+	p = trace->blocks[id];
+	if (op->type != ALLOC && op->type != CALLOC && 
+	    op->type != MEMALIGN && p != NULL && 
+	    trace->block_sizes[id] >= sizeof(int) && *(int *)p != id) {
+	    REPLAY_ERROR(thr, i, "Payload overwritten by another block.");
+	    p = NULL;  /* leak it rather than free a block twice */
+	}
+
+	switch (op->type) {
+	case ALLOC: /* mm_malloc */
+	case CALLOC: /* mm_calloc */
+	case MEMALIGN: /* mm_memalign */
+	    if ((p = alloc_op(op)) == NULL && size > 0)
+		REPLAY_ERROR(thr, i, "mm_malloc failed.");
 	    break;
 
-	case REALLOC: /* realloc */
-	    index = trace->ops[i].index;
-	    newsize = trace->ops[i].size;
-	    oldp = trace->blocks[index];
-	    if ((newp = realloc(oldp, newsize)) == NULL)
-		unix_error("realloc failed in eval_libc_speed\n");
-	    
-	    trace->blocks[index] = newp;
+	case REALLOC: /* mm_realloc */
+	    if ((p = mm->realloc(p, size)) == NULL && size > 0)
+		REPLAY_ERROR(thr, i, "mm_realloc failed.");
 	    break;
-	    
-        case FREE: /* free */
-	    index = trace->ops[i].index;
-	    block = trace->blocks[index];
-	    free(block);
+
+	case FREE: /* mm_free */
+	case SIZED_FREE: /* mm_free_sized */
+	    if (p != NULL)
+		free_op(op, p);
+	    p = NULL;
+	    size = 0;
 	    break;
 	}
+	if (p != NULL && size >= sizeof(int))
+	    *(int *)p = id;
+	trace->blocks[id] = p;
+	trace->block_sizes[id] = size;
+
+	/* Let the next op on this id go, even if this one failed */
+	__atomic_store_n(&thr->seq[id], thr->ords[i] + 1, __ATOMIC_RELEASE);
+    }
+
+    __atomic_store_n(&thr->progress[thr->self], INT_MAX, __ATOMIC_RELEASE);
+    thr->end = replay_clock();
+    return NULL;
+}
+
+/*
+ * replay_threads - Split trace across nthreads threads and replay it 
+ *    once on a fresh heap, returning the wall time of the replay. The 
+ *    ops on an id run on thread id % nthreads, except that frees of 
+ *    odd ids run on the next thread, so that with several threads half
+ *    of all frees are cross-thread. thr[] must hold nthreads entries.
+ */
+static double replay_threads(trace_t *trace, int tracenum, int nthreads,
+			     replay_thread_t *thr)
+{
+    pthread_t tids[MAX_THREADS];
+    int progress[MAX_THREADS];
+    pthread_barrier_t start;
+    unsigned int *seq;
+    int *alloc_thread;
+    int i, t, id;
+    double begin, end;
+
+    if ((seq = (unsigned int *)calloc(trace->num_ids, 
+				      sizeof(unsigned int))) == NULL ||
+	(alloc_thread = (int *)calloc(trace->num_ids, sizeof(int))) == NULL)
+	unix_error("calloc failed in replay_threads");
+    for (t = 0; t < nthreads; t++) {
+	thr[t].trace = trace;
+	thr[t].seq = seq;
+	thr[t].progress = progress;
+	thr[t].nthreads = nthreads;
+	thr[t].self = t;
+	thr[t].start = &start;
+	progress[t] = 0;
+	thr[t].num_ops = thr[t].cross = thr[t].errors = 0;
+	if ((thr[t].ops = (int *)malloc(trace->num_ops * sizeof(int))) == NULL ||
+	    (thr[t].ords = (int *)malloc(trace->num_ops * sizeof(int))) == NULL)
+	    unix_error("malloc failed in replay_threads");
+    }
+
+    /* Deal the ops out, numbering the ops on each id in seq[] */
+    for (i = 0; i < trace->num_ops; i++) {
+	id = trace->ops[i].index;
+	t = id % nthreads;
+	if (trace->ops[i].type == FREE || trace->ops[i].type == SIZED_FREE) {
+	    t = (id + (id & 1)) % nthreads;
+	    thr[t].cross += (t != alloc_thread[id]);
+	}
+	else
+	    alloc_thread[id] = t;
+	thr[t].ops[thr[t].num_ops] = i;
+	thr[t].ords[thr[t].num_ops++] = seq[id]++;
+    }
+    memset(seq, 0, trace->num_ids * sizeof(unsigned int));
+
+    /* Reset the heap and initialize the mm package */
+    reset_heap(trace);
+    memset(trace->blocks, 0, trace->num_ids * sizeof(char *));
+    if (mm->init() < 0) 
+	app_error("mm_init failed in replay_threads");
+
+    /* Time from the first thread starting to the last one finishing */
+    pthread_barrier_init(&start, NULL, nthreads);
+    for (t = 0; t < nthreads; t++)
+	if (pthread_create(&tids[t], NULL, replay_thread, &thr[t]) != 0)
+	    app_error("pthread_create failed in replay_threads");
+    begin = DBL_MAX;
+    end = 0;
+    for (t = 0; t < nthreads; t++) {
+	pthread_join(tids[t], NULL);
+	begin = (thr[t].begin < begin) ? thr[t].begin : begin;
+	end = (thr[t].end > end) ? thr[t].end : end;
+    }
+    pthread_barrier_destroy(&start);
+
+    for (t = 0; t < nthreads; t++) {
+	if (thr[t].errors > 0) {
+	    malloc_error(tracenum, thr[t].error_op, thr[t].error_msg);
+	    errors += thr[t].errors - 1;
+	}
+	free(thr[t].ops);
+	free(thr[t].ords);
+    }
+    free(seq);
+    free(alloc_thread);
+    return end - begin;
+}
+
+/*
+ * eval_mm_threads - Replay every tracefile on one thread and on 
+ *    nthreads threads against the threaded mode of the mm package, and
+ *    print the throughput of both, the speedup and the scaling 
+ *    efficiency (speedup / nthreads). With -v, also print the Kops of 
+ *    each thread. Each replay is run THREAD_RUNS times and the fastest 
+ *    counts.
+ */
+static void eval_mm_threads(int num_tracefiles, char **tracefiles, 
+			    int nthreads)
+{
+    int i, j, t, run, cross;
+    trace_t *trace;
+    replay_thread_t thr[MAX_THREADS], best[MAX_THREADS];
+    double secs, secs1, secsn, speedup;
+    double total_ops = 0, total1 = 0, totaln = 0;
+
+    mm->set_threaded(1);
+    printf("%5s%8s%8s%12s%12s%9s%7s\n", 
+	   "trace", "ops", "cross", "1-thr Kops", "n-thr Kops", "speedup", 
+	   "effic");
+    for (i=0; i < num_tracefiles; i++) {
+	trace = read_trace(tracedir, tracefiles[i]);
+
+	/* The ops of a batch span ids that may belong to other threads */
+	for (j = 0; j < trace->num_ops; j++)
+	    if (OP_IDS(&trace->ops[j]) != 1)
+		break;
+	if (j < trace->num_ops) {
+	    printf("%2d%11d%8s%12s%12s%9s%7s\n", i, trace->num_ops, "-", 
+		   "-", "-", "-", "-");
+	    free_trace(trace);
+	    continue;
+	}
+
+	secs1 = secsn = DBL_MAX;
+	for (run = 0; run < THREAD_RUNS; run++) {
+	    if ((secs = replay_threads(trace, i, 1, thr)) < secs1)
+		secs1 = secs;
+	    if ((secs = replay_threads(trace, i, nthreads, thr)) < secsn) {
+		secsn = secs;
+		memcpy(best, thr, nthreads * sizeof(replay_thread_t));
+	    }
+	}
+
+	cross = 0;
+	for (t = 0; t < nthreads; t++)
+	    cross += best[t].cross;
+	speedup = secs1 / secsn;
+	printf("%2d%11d%8d%12.0f%12.0f%8.2fx%6.0f%%\n", 
+	       i, trace->num_ops, cross,
+	       (trace->num_ops/1e3)/secs1, 
+	       (trace->num_ops/1e3)/secsn,
+	       speedup, 100.0*speedup/nthreads);
+	if (verbose) {
+	    printf("%13s", "per-thread:");
+	    for (t = 0; t < nthreads; t++)
+		printf(" %.0f", 
+		       (best[t].num_ops/1e3)/(best[t].end - best[t].begin));
+	    printf("\n");
+	}
+	total_ops += trace->num_ops;
+	total1 += secs1;
+	totaln += secsn;
+	free_trace(trace);
     }
+    if (total_ops == 0) {  /* every trace was skipped */
+	mm->set_threaded(0);
+	return;
+    }
+    speedup = total1 / totaln;
+    printf("%5s%8.0f%8s%12.0f%12.0f%8.2fx%6.0f%%\n", 
+	   "Total", total_ops, "",
+	   (total_ops/1e3)/total1, 
+	   (total_ops/1e3)/totaln,
+	   speedup, 100.0*speedup/nthreads);
+    mm->set_threaded(0);
 }
 
 /*************************************
@@ -972,6 +2888,613 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printevents - prints how often mm.c extended the heap and how many
+ *     reallocs moved the payload or grew in place, per trace
+ */
+static void printevents(int n, stats_t *stats) 
+{
+    int i;
+    double extends = 0, copies = 0, inplace = 0;
+
+    printf("%5s%10s%10s%10s\n", "trace", "sbrks", "moved", "in-place");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    printf("%2d%13lu%10lu%10lu\n", 
+		   i,
+		   stats[i].events.extend_heaps,
+		   stats[i].events.realloc_copies,
+		   stats[i].events.realloc_inplace);
+	    extends += stats[i].events.extend_heaps;
+	    copies += stats[i].events.realloc_copies;
+	    inplace += stats[i].events.realloc_inplace;
+	}
+	else {
+	    printf("%2d%13s%10s%10s\n", i, "-", "-", "-");
+	}
+    }
+    printf("%5s%10.0f%10.0f%10.0f\n", "Total", extends, copies, inplace);
+}
+
+/*
+ * printlocality - prints the heap words that each op of mm.c read and
+ *     wrote in the traced replay, and the lookups per op that missed
+ *     in the simulated cache (if -S), per trace
+ */
+static void printlocality(int n, stats_t *stats) 
+{
+    int i;
+    double ops = 0, loads = 0, stores = 0, misses = 0, lookups = 0;
+    addrcount_t *c;
+
+    printf("%5s%10s%10s%10s%10s\n", 
+	   "trace", "loads/op", "stores/op", "misses/op", "miss rate");
+    for (i=0; i < n; i++) {
+	c = &stats[i].cache;
+	if (!stats[i].valid || c->loads + c->stores == 0) {
+	    printf("%5d%10s%10s%10s%10s\n", i, "-", "-", "-", "-");
+	    continue;
+	}
+	printf("%5d%10.2f%10.2f", i, 
+	       c->loads / stats[i].ops, c->stores / stats[i].ops);
+	if (addrtrace_cached())
+	    printf("%10.3f%9.2f%%\n", c->misses / stats[i].ops, 
+		   c->misses * 100.0 / (c->hits + c->misses));
+	else
+	    printf("%10s%10s\n", "-", "-");
+	ops += stats[i].ops;
+	loads += c->loads;
+	stores += c->stores;
+	misses += c->misses;
+	lookups += c->hits + c->misses;
+    }
+    if (ops == 0)
+	return;
+    printf("%5s%10.2f%10.2f", "Total", loads / ops, stores / ops);
+    if (addrtrace_cached())
+	printf("%10.3f%9.2f%%\n", misses / ops, misses * 100.0 / lookups);
+    else
+	printf("%10s%10s\n", "-", "-");
+}
+
+/*
+ * writejson - Write str to fp as a JSON string, quoted and escaped
+ */
+static void writejson(FILE *fp, char *str)
+{
+    unsigned char *c;
+
+    fputc('"', fp);
+    for (c = (unsigned char *)str; *c != '\0'; c++) {
+	if (*c == '"' || *c == '\\')
+	    fprintf(fp, "\\%c", *c);
+	else if (*c < 0x20)
+	    fprintf(fp, "\\u%04x", *c);
+	else
+	    fputc(*c, fp);
+    }
+    fputc('"', fp);
+}
+
+/*
+ * writeresults - Write the per-trace mm stats to path, as JSON if the
+ *     name ends in ".json" and as CSV otherwise. Hardware counts that
+ *     were not collected (no -P, or no counter) are written as -1.
+ */
+static void writeresults(char *path, int n, char **tracefiles, 
+			 stats_t *stats)
+{
+    FILE *fp;
+    int i, e, json;
+    size_t len = strlen(path);
+    stats_t *s, st;
+
+    json = (len >= 5 && strcmp(path + len - 5, ".json") == 0);
+    if ((fp = fopen(path, "w")) == NULL) {
+	sprintf(msg, "Could not open %s in writeresults", path);
+	unix_error(msg);
+    }
+
+    if (json) {
+	fprintf(fp, "{\"allocator\": ");
+	writejson(fp, mm->name);
+	fprintf(fp, ", \"traces\": [\n");
+    }
+    else {
+	fprintf(fp, "trace,valid,util,ops,secs,kops,noise,"
+		"extend_heaps,realloc_copies,realloc_inplace");
+	for (e = 0; e < PERFCTR_EVENTS; e++)
+	    fprintf(fp, ",%s", perfctr_names[e]);
+	fprintf(fp, "\n");
+    }
+    for (i = 0; i < n; i++) {
+	/* secs and util are undefined for an invalid trace; write 0s
+	   without touching the stats the caller still reads */
+	st = stats[i];
+	s = &st;
+	if (!s->valid)
+	    s->secs = s->util = 0;
+	if (json) {
+	    fprintf(fp, "  {\"trace\": ");
+	    writejson(fp, tracefiles[i]);
+	    fprintf(fp, ", \"valid\": %s, "
+		    "\"util\": %.6f, \"ops\": %.0f, \"secs\": %.9f, "
+		    "\"kops\": %.3f, \"noise\": %.6f,\n", 
+		    s->valid ? "true" : "false", s->util, 
+		    s->ops, s->secs, s->valid ? (s->ops/1e3)/s->secs : 0, 
+		    s->noise);
+	    fprintf(fp, "   \"extend_heaps\": %lu, \"realloc_copies\": %lu, "
+		    "\"realloc_inplace\": %lu", s->events.extend_heaps, 
+		    s->events.realloc_copies, s->events.realloc_inplace);
+	    for (e = 0; e < PERFCTR_EVENTS; e++)
+		fprintf(fp, ", \"%s\": %.0f", perfctr_names[e], 
+			count_events ? s->perf.counts[e] : -1);
+	    fprintf(fp, "}%s\n", (i < n - 1) ? "," : "");
+	}
+	else {
+	    fprintf(fp, "%s,%d,%.6f,%.0f,%.9f,%.3f,%.6f,%lu,%lu,%lu", 
+		    tracefiles[i], s->valid, s->util, s->ops, s->secs, 
+		    s->valid ? (s->ops/1e3)/s->secs : 0, s->noise, 
+		    s->events.extend_heaps, s->events.realloc_copies, 
+		    s->events.realloc_inplace);
+	    for (e = 0; e < PERFCTR_EVENTS; e++)
+		fprintf(fp, ",%.0f", count_events ? s->perf.counts[e] : -1);
+	    fprintf(fp, "\n");
+	}
+    }
+    if (json)
+	fprintf(fp, "]}\n");
+    fclose(fp);
+}
+
+/*
+ * noise_sigmas - How many std devs of noise a Kops drop must exceed when
+ *     the noise of each run was estimated from only `repeats` timings:
+ *     Student's t with 2*(repeats - 1) degrees of freedom at the
+ *     one-sided level of NOISE_SIGMAS std devs of a normal
+ */
+static double noise_sigmas(void)
+{
+    static const double t[] = {0, 0, 19.21, 6.62, 4.90, 4.28, 3.96, 3.76,
+			       3.64, 3.54, 3.48};
+
+    return (repeats < (int)(sizeof(t) / sizeof(t[0]))) ? t[repeats] 
+						       : NOISE_SIGMAS;
+}
+
+/*
+ * comparebaseline - Compare the per-trace mm stats with the CSV at path
+ *     (written by -o), print a row per trace, and return the number of
+ *     traces that regressed. A trace regresses if it was valid and no
+ *     longer is, if its util dropped by more than MIN_UTIL_DROP, or if
+ *     its Kops dropped by more than noise_sigmas() times the combined 
+ *     noise of both runs and more than MIN_KOPS_DROP of the baseline.
+ *     Traces that ran in less than MIN_TIMED_SECS in either run are too
+ *     short for their Kops to mean much; their Kops is compared once,
+ *     over all of them together, if that adds up to MIN_TIMED_SECS.
+ */
+static int comparebaseline(char *path, int n, char **tracefiles, 
+			   stats_t *stats)
+{
+    FILE *fp;
+    char line[MAXLINE], name[MAXLINE];
+    char **names;
+    int *valid;
+    double *util, *ops, *secs, *kops, *noise;
+    int i, j, rows, regressions = 0, pooled = 0;
+    double cur, drop, limit;
+    double pool_base_ops = 0, pool_base_secs = 0, pool_ops = 0, pool_secs = 0;
+    double pool_base_var = 0, pool_var = 0, base;
+    char *verdict;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+	snprintf(msg, sizeof(msg), "Could not open %s in comparebaseline", 
+		 path);
+	unix_error(msg);
+    }
+    rows = 0;
+    while (fgets(line, MAXLINE, fp) != NULL)
+	rows++;
+    rewind(fp);
+    names = (char **)calloc(rows, sizeof(char *));
+    valid = (int *)calloc(rows, sizeof(int));
+    util = (double *)calloc(rows, sizeof(double));
+    ops = (double *)calloc(rows, sizeof(double));
+    secs = (double *)calloc(rows, sizeof(double));
+    kops = (double *)calloc(rows, sizeof(double));
+    noise = (double *)calloc(rows, sizeof(double));
+    if (!names || !valid || !util || !ops || !secs || !kops || !noise)
+	unix_error("calloc failed in comparebaseline");
+
+    /* Skip the header, then read trace,valid,util,ops,secs,kops,noise */
+    fgets(line, MAXLINE, fp);
+    for (rows = 0; fgets(line, MAXLINE, fp) != NULL; rows++) {
+	if (sscanf(line, "%[^,],%d,%lf,%lf,%lf,%lf,%lf", name, &valid[rows],
+		   &util[rows], &ops[rows], &secs[rows], &kops[rows], 
+		   &noise[rows]) != 7) {
+	    sprintf(msg, "Bad line %d in baseline %s", rows + 2, path);
+	    app_error(msg);
+	}
+	names[rows] = strdup(name);
+    }
+    fclose(fp);
+
+    printf("%5s%11s%7s%11s%8s%8s%8s  %s\n", "trace", "base util", "util", 
+	   "base Kops", "Kops", "change", "limit", "");
+    for (i = 0; i < n; i++) {
+	/* Match on the file name, so that -f traces/x.rep matches x.rep */
+	for (j = 0; j < rows && strcmp(BASENAME(names[j]), 
+				       BASENAME(tracefiles[i])) != 0; j++)
+	    ;
+	if (j == rows) {
+	    printf("%2d%s\n", i, "   not in baseline");
+	    continue;
+	}
+	if (!stats[i].valid || !valid[j]) {
+	    verdict = (valid[j] && !stats[i].valid) ? "REGRESSED (invalid)" : "";
+	    regressions += (valid[j] && !stats[i].valid);
+	    printf("%2d%10s%7s%11s%8s%8s%8s  %s\n", i, "-", "-", "-", "-", 
+		   "-", "-", verdict);
+	    continue;
+	}
+	cur = (stats[i].ops/1e3)/stats[i].secs;
+	drop = (kops[j] - cur) / kops[j];
+	verdict = "";
+	if (util[j] - stats[i].util > MIN_UTIL_DROP)
+	    verdict = "REGRESSED (util)";
+	regressions += (*verdict != '\0');
+	if (secs[j] < MIN_TIMED_SECS || stats[i].secs < MIN_TIMED_SECS) {
+	    /* Too short to time alone: leave its Kops to the pool */
+	    pooled++;
+	    pool_base_ops += ops[j];
+	    pool_base_secs += secs[j];
+	    pool_ops += stats[i].ops;
+	    pool_secs += stats[i].secs;
+	    pool_base_var += secs[j]*noise[j] * secs[j]*noise[j];
+	    pool_var += stats[i].secs*stats[i].noise * stats[i].secs*stats[i].noise;
+	    printf("%2d%9.1f%%%6.1f%%%11.0f%8.0f%7.1f%%%8s  %s\n", i, 
+		   util[j]*100.0, stats[i].util*100.0, kops[j], cur, 
+		   -drop*100.0, "pool", verdict);
+	    continue;
+	}
+	limit = noise_sigmas() * sqrt(noise[j]*noise[j] + 
+				    stats[i].noise*stats[i].noise);
+	limit = (limit > MIN_KOPS_DROP) ? limit : MIN_KOPS_DROP;
+	if (!*verdict && drop > limit) {
+	    verdict = "REGRESSED (Kops)";
+	    regressions++;
+	}
+	printf("%2d%9.1f%%%6.1f%%%11.0f%8.0f%7.1f%%%7.1f%%  %s\n", i, 
+	       util[j]*100.0, stats[i].util*100.0, kops[j], cur, -drop*100.0, 
+	       limit*100.0, verdict);
+    }
+
+    /* The pooled short traces, as if they were one trace */
+    if (pooled > 0 && (pool_base_secs < MIN_TIMED_SECS || 
+		       pool_secs < MIN_TIMED_SECS))
+	printf("%5s  %d traces too short to compare their Kops\n", "pool", 
+	       pooled);
+    else if (pooled > 0) {
+	base = (pool_base_ops/1e3)/pool_base_secs;
+	cur = (pool_ops/1e3)/pool_secs;
+	drop = (base - cur) / base;
+	limit = noise_sigmas() * 
+	    sqrt(pool_base_var / (pool_base_secs * pool_base_secs) + 
+		 pool_var / (pool_secs * pool_secs));
+	limit = (limit > MIN_KOPS_DROP) ? limit : MIN_KOPS_DROP;
+	verdict = (drop > limit) ? "REGRESSED (Kops)" : "";
+	regressions += (*verdict != '\0');
+	printf("%5s%10s%7s%11.0f%8.0f%7.1f%%%7.1f%%  %s\n", "pool", "-", "-", 
+	       base, cur, -drop*100.0, limit*100.0, verdict);
+    }
+
+    for (j = 0; j < rows; j++)
+	free(names[j]);
+    free(names); free(valid); free(util); free(ops); free(secs); 
+    free(kops); free(noise);
+    return regressions;
+}
+
+/*
+ * printperf - prints Kops and the hardware events per op of each trace,
+ *     to tell fewer instructions apart from fewer cache misses
+ */
+static void printperf(int n, stats_t *stats) 
+{
+    int i, e, counted = 0;
+    double c;
+
+    printf("%5s%6s", "trace", "Kops");
+    for (e = 0; e < PERFCTR_EVENTS; e++)
+	printf("%10s", perfctr_names[e]);
+    printf("%6s\n", "IPC");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid) {
+	    printf("%2d%9s\n", i, "-");
+	    continue;
+	}
+	printf("%2d%9.0f", i, (stats[i].ops/1e3)/stats[i].secs);
+	for (e = 0; e < PERFCTR_EVENTS; e++) {
+	    if ((c = stats[i].perf.counts[e]) < 0) {
+		printf("%10s", "-");
+		continue;
+	    }
+	    printf("%10.2f", c / stats[i].ops);
+	    counted = 1;
+	}
+	if (stats[i].perf.counts[PERFCTR_INSTRUCTIONS] >= 0 && 
+	    stats[i].perf.counts[PERFCTR_CYCLES] > 0)
+	    printf("%6.2f\n", stats[i].perf.counts[PERFCTR_INSTRUCTIONS] /
+		   stats[i].perf.counts[PERFCTR_CYCLES]);
+	else
+	    printf("%6s\n", "-");
+    }
+    if (!counted)
+	printf("No hardware counters available: perf_event_open failed "
+	       "(see /proc/sys/kernel/perf_event_paranoid)\n");
+}
+
+/*
+ * printlatency - prints the count and latency percentiles of each 
+ *     type of mm call, per trace and over all traces
+ */
+static void printlatency(int n, stats_t *stats) 
+{
+    static char *names[NUM_OP_TYPES] = {"malloc", "free", "realloc", 
+					"calloc", "memalign", "free_sized", 
+					"malloc_batch", "free_batch"};
+    lathist_t total[NUM_OP_TYPES];
+    lathist_t *h;
+    int i, type;
+
+    for (type = 0; type < NUM_OP_TYPES; type++)
+	lathist_clear(&total[type]);
+    printf("%5s%13s%10s%8s%8s%8s%10s\n", 
+	   "trace", "call", "count", "p50", "p99", "p99.9", "max");
+    for (i=0; i <= n; i++) {
+	for (type = 0; type < NUM_OP_TYPES; type++) {
+	    if (i < n) {
+		if (!stats[i].valid)
+		    continue;
+		h = &stats[i].lat[type];
+		lathist_merge(&total[type], h);
+	    }
+	    else
+		h = &total[type];
+	    if (h->count == 0)
+		continue;
+	    if (i < n)
+		printf("%2d", i);
+	    else
+		printf("%5s", "Total");
+	    printf("%*s%10lu%8llu%8llu%8llu%10llu\n", 
+		   (i < n) ? 16 : 13, names[type], h->count,
+		   lathist_percentile(h, 50), 
+		   lathist_percentile(h, 99),
+		   lathist_percentile(h, 99.9),
+		   h->max);
+	}
+    }
+}
+
+/*
+ * printtimeline - plots the heap samples of each trace, one row per 
+ *     sample. The bar splits the heap into live payload (#), free 
+ *     list blocks (-) and the rest (.), i.e. headers, footers, padding
+ *     and unsplit surplus; its length is the heap size relative to the 
+ *     trace's final heap. util is the peak payload so far over the heap.
+ */
+static void printtimeline(int n, char **tracefiles, stats_t *stats) 
+{
+    int i, j, k, nlive, nfree, nheap;
+    size_t max_heap;
+    sample_t *t;
+
+    printf("(# live payload, - free lists, . headers, padding and surplus)\n");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid || stats[i].num_samples == 0)
+	    continue;
+	printf("%2d %s\n", i, tracefiles[i]);
+	printf("%10s%13s%6s%6s%6s%8s\n", 
+	       "op", "heap", "util", "live", "free", "blocks");
+	max_heap = stats[i].timeline[stats[i].num_samples - 1].heap;
+	for (j = 0; j < stats[i].num_samples; j++) {
+	    t = &stats[i].timeline[j];
+	    nheap = (int)((double)t->heap / max_heap * TIMELINE_WIDTH + 0.5);
+	    nlive = (int)((double)t->live / max_heap * TIMELINE_WIDTH + 0.5);
+	    nfree = (int)((double)t->free_bytes / max_heap * TIMELINE_WIDTH + 0.5);
+	    if (nlive > nheap)
+		nlive = nheap;
+	    if (nlive + nfree > nheap)
+		nfree = nheap - nlive;
+	    printf("%10d%13lu%5.0f%%%5.0f%%%5.0f%%%8lu |", t->op, 
+		   (unsigned long)t->heap, 100.0 * t->peak / t->heap,
+		   100.0 * t->live / t->heap, 100.0 * t->free_bytes / t->heap,
+		   t->free_blocks);
+	    for (k = 0; k < TIMELINE_WIDTH; k++)
+		putchar((k < nlive) ? '#' : (k < nlive + nfree) ? '-' : 
+			(k < nheap) ? '.' : ' ');
+	    printf("|\n");
+	}
+    }
+}
+
+/*
+ * writetimeline - Write the heap samples of every trace to path as
+ *     CSV, one row per sample
+ */
+static void writetimeline(char *path, int n, char **tracefiles, 
+			  stats_t *stats)
+{
+    FILE *fp;
+    int i, j;
+    sample_t *t;
+
+    if ((fp = fopen(path, "w")) == NULL) {
+	sprintf(msg, "Could not open %s in writetimeline", path);
+	unix_error(msg);
+    }
+    fprintf(fp, "trace,op,heap,live,peak,free_bytes,free_blocks,util\n");
+    for (i = 0; i < n; i++) {
+	if (!stats[i].valid)
+	    continue;
+	for (j = 0; j < stats[i].num_samples; j++) {
+	    t = &stats[i].timeline[j];
+	    fprintf(fp, "%s,%d,%lu,%lu,%lu,%lu,%lu,%.6f\n", tracefiles[i], 
+		    t->op, (unsigned long)t->heap, (unsigned long)t->live, 
+		    (unsigned long)t->peak, t->free_bytes, t->free_blocks, 
+		    (double)t->peak / t->heap);
+	}
+    }
+    fclose(fp);
+}
+
+/*
+ * writeoptimes - writes the fewest ticks of each op of trace, from 
+ *     eval_mm_latency, to path as a dump of optime.h
+ */
+static void writeoptimes(char *path, trace_t *trace, lattick_t *best)
+{
+    FILE *fp;
+    optimehdr_t hdr;
+    optime_t *recs;
+    int i;
+
+    if ((recs = (optime_t *)calloc(trace->num_ops, sizeof(optime_t))) == NULL)
+	unix_error("calloc failed in writeoptimes");
+    for (i = 0; i < trace->num_ops; i++) {
+	recs[i].ticks = (best[i] > UINT_MAX) ? UINT_MAX : (unsigned int)best[i];
+	recs[i].type = trace->ops[i].type;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, OPTIME_MAGIC, sizeof(hdr.magic));
+    hdr.version = OPTIME_VERSION;
+    hdr.rec_size = sizeof(optime_t);
+    hdr.seed = seed;
+    hdr.num_ops = trace->num_ops;
+    hdr.runs = LATENCY_RUNS;
+    strcpy(hdr.unit, LATHIST_UNIT);
+
+    if ((fp = fopen(path, "wb")) == NULL) {
+	snprintf(msg, sizeof(msg), "Could not open %.900s in writeoptimes", path);
+	unix_error(msg);
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	fwrite(recs, sizeof(optime_t), trace->num_ops, fp) != 
+	(size_t)trace->num_ops || fclose(fp) != 0) {
+	snprintf(msg, sizeof(msg), "Could not write %.900s in writeoptimes", path);
+	unix_error(msg);
+    }
+    free(recs);
+}
+
+/*
+ * printvariants - prints util and Kops of every allocator in the 
+ *     NULL-terminated list[], one column each, so that policies and 
+ *     backends can be compared per trace. The util of a backend with 
+ *     its own heap is unknown and printed as "-".
+ */
+static void printvariants(int n, allocator_t **list, stats_t **stats) 
+{
+    int i, j, nvariants;
+    double secs, ops, util;
+
+    printf("%5s", "trace");
+    for (j=0; list[j] != NULL; j++)
+	printf("%15s", list[j]->name);
+    nvariants = j;
+    printf("\n");
+
+/* Print the util column of allocator j */
+#define PRINT_UTIL(j, u) do { \
+    if (list[j]->flags & ALLOC_HEAP) \
+	printf("%7.0f%%", (u)*100.0); \
+    else \
+	printf("%8s", "-"); } while (0)
+
+    for (i=0; i < n; i++) {
+	printf("%5d", i);
+	for (j=0; j < nvariants; j++) {
+	    if (stats[j][i].valid) {
+		PRINT_UTIL(j, stats[j][i].util);
+		printf("%7.0f", (stats[j][i].ops/1e3)/stats[j][i].secs);
+	    }
+	    else
+		printf("%15s", "-");
+	}
+	printf("\n");
+    }
+
+    /* Print the aggregate results for each variant */
+    printf("%5s", "Total");
+    for (j=0; j < nvariants; j++) {
+	secs = ops = util = 0;
+	for (i=0; i < n; i++) {
+	    if (!stats[j][i].valid)
+		break;
+	    secs += stats[j][i].secs;
+	    ops += stats[j][i].ops;
+	    util += stats[j][i].util;
+	}
+	if (i == n) {
+	    PRINT_UTIL(j, util/n);
+	    printf("%7.0f", (ops/1e3)/secs);
+	}
+	else
+	    printf("%15s", "-");
+    }
+    printf("\n");
+#undef PRINT_UTIL
+}
+
+/*
+ * printvariantlocality - prints the simulated cache misses per op of 
+ *     every allocator in the NULL-terminated list[], one column each.
+ *     Backends other than mm.c miss only on their payloads (with -D)
+ *     and print "-" otherwise.
+ */
+static void printvariantlocality(int n, allocator_t **list, stats_t **stats)
+{
+    int i, j, nvariants;
+    double ops, misses;
+    addrcount_t *c;
+
+    printf("%5s", "trace");
+    for (j=0; list[j] != NULL; j++)
+	printf("%15s", list[j]->name);
+    nvariants = j;
+    printf("\n");
+
+    for (i=0; i < n; i++) {
+	printf("%5d", i);
+	for (j=0; j < nvariants; j++) {
+	    c = &stats[j][i].cache;
+	    if (stats[j][i].valid && c->loads + c->stores > 0)
+		printf("%15.3f", c->misses / stats[j][i].ops);
+	    else
+		printf("%15s", "-");
+	}
+	printf("\n");
+    }
+
+    printf("%5s", "Total");
+    for (j=0; j < nvariants; j++) {
+	ops = misses = 0;
+	for (i=0; i < n; i++) {
+	    c = &stats[j][i].cache;
+	    if (!stats[j][i].valid || c->loads + c->stores == 0)
+		break;
+	    ops += stats[j][i].ops;
+	    misses += c->misses;
+	}
+	if (i == n)
+	    printf("%15.3f", misses / ops);
+	else
+	    printf("%15s", "-");
+    }
+    printf("\n");
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -1004,14 +3527,41 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hADFHvValpPs] [-f <file>] [-j <n>] [-m <name>] [-t <dir>]\n");
+    fprintf(stderr, "               [-T <n>] [-o <file>] [-b <file>] [-R <n>] [-U <n>] [-u <file>]\n");
+    fprintf(stderr, "               [-C <cpus>] [-K <k>[:<eps>[:<max>]]] [-c <bytes>] [-W <n>]\n");
+    fprintf(stderr, "               [-L <file>] [-S <s>:<E>:<b>] [-Y <file>] [-O <file>] [-z <seed>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-A         Compare every allocator backend (mm.c variants, libc, bump, ...).\n");
+    fprintf(stderr, "\t-b <file>  Compare with a CSV from -o; exit 2 on a regression.\n");
+    fprintf(stderr, "\t-c <bytes> Flush <bytes> of cache before each timed run (0: don't; default LLC).\n");
+    fprintf(stderr, "\t-C <cpus>  Run on CPUs <cpus> only (e.g. 2 or 0,2-3); -j workers get one each.\n");
+    fprintf(stderr, "\t-D         With -L or -S, trace the payload writes of the application too.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-F         Check sampled words of each payload (also at free), not every byte.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-H         Print latency percentiles of mm.c calls.\n");
+    fprintf(stderr, "\t-j <n>     Evaluate mm.c on up to <n> traces at once, one process each.\n");
+    fprintf(stderr, "\t-K <k>[:<eps>[:<max>]] Time the fastest of <k> runs within <eps> (default 3:0.01).\n");
+    fprintf(stderr, "\t-L <file>  Write the addresses mm.c touches to <file> (%%t: trace name) for csim.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-m <name>  Evaluate allocator backend <name> instead of mm.c.\n");
+    fprintf(stderr, "\t-o <file>  Write the mm results to <file> (.json for JSON, else CSV).\n");
+    fprintf(stderr, "\t-O <file>  Write the time of every op to <file> (%%t: trace name) for optimediff.\n");
+    fprintf(stderr, "\t-p         Compare the policy variants of mm.c.\n");
+    fprintf(stderr, "\t-R <n>     Time each trace <n> times to measure the noise.\n");
+    fprintf(stderr, "\t-P         Count hardware events (instructions, misses) per op.\n");
+    fprintf(stderr, "\t-S <s>:<E>:<b> Simulate a cache of 2^s sets, E lines, 2^b-byte blocks.\n");
+    fprintf(stderr, "\t-s         Stream traces through mm.c once, unchecked.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <n>     Also replay each trace on <n> threads, with cross-thread frees.\n");
+    fprintf(stderr, "\t-u <file>  Write heap samples of each trace to <file> as CSV.\n");
+    fprintf(stderr, "\t-U <n>     Plot heap, payload and free lists at <n> points of each trace.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
+    fprintf(stderr, "\t-W <n>     Run each trace <n> times untimed before timing it.\n");
+    fprintf(stderr, "\t-Y <file>  Write the heap layout at the payload peak to <file> (%%t: trace name).\n");
+    fprintf(stderr, "\t-z <seed>  Seed the checks with <seed>; time exactly <k> runs (see -K).\n");
 }
@@ -14,15 +14,46 @@
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <pthread.h>
+
+/*
+ * Policy variants (see Makefile): when MM_VARIANT is defined, the public
+ * functions are renamed to <MM_VARIANT>_init, <MM_VARIANT>_malloc, ...
+ * so that several instantiations of this file can be linked into mdriver.
+ */
+#ifdef MM_VARIANT
+#define MM_CONCAT(prefix, name) prefix ## _ ## name
+#define MM_NAME(prefix, name) MM_CONCAT(prefix, name)
+#define mm_init MM_NAME(MM_VARIANT, init)
+#define mm_malloc MM_NAME(MM_VARIANT, malloc)
+#define mm_free MM_NAME(MM_VARIANT, free)
+#define mm_realloc MM_NAME(MM_VARIANT, realloc)
+#define mm_check MM_NAME(MM_VARIANT, check)
+#define mm_malloc_cacheline MM_NAME(MM_VARIANT, malloc_cacheline)
+#define mm_set_threaded MM_NAME(MM_VARIANT, set_threaded)
+#define mm_get_stats MM_NAME(MM_VARIANT, get_stats)
+#define mm_usable_size MM_NAME(MM_VARIANT, usable_size)
+#define mm_dump_layout MM_NAME(MM_VARIANT, dump_layout)
+#define mm_calloc MM_NAME(MM_VARIANT, calloc)
+#define mm_memalign MM_NAME(MM_VARIANT, memalign)
+#define mm_free_sized MM_NAME(MM_VARIANT, free_sized)
+#define mm_malloc_batch MM_NAME(MM_VARIANT, malloc_batch)
+#define mm_free_batch MM_NAME(MM_VARIANT, free_batch)
+#endif
 
 #include "mm.h"
 #include "memlib.h"
+#include "sizeclass.h"
+#include "layout.h"
+#ifdef MM_ADDR_TRACE
+#include "addrtrace.h"
+#endif
 
-/* single word (4) or double word (8) alignment */
-#define ALIGNMENT 8
+/* double word alignment: 8 bytes on 32-bit hosts, 16 on 64-bit hosts */
+#define ALIGNMENT DWORDSIZE
 
 /* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(size_t)(ALIGNMENT-1))
 
 
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
@@ -31,12 +62,28 @@
 #define FREE 0
 #define ALLOCATED 1
 
-#define WORDSIZE 4
-#define DWORDSIZE 8
+// Headers, footers and free list links are size_t words, so a block, and the heap, may be larger than 4 GB
+#define WORDSIZE sizeof(size_t)
+#define DWORDSIZE (2 * WORDSIZE)
 #define PAGESIZE (1 << 12)
 
-#define GET(ptr) (*(unsigned int *)(ptr))
-#define PUT(ptr, val) (*(unsigned int *)(ptr) = (val))   
+// Address-traced build (MM_ADDR_TRACE, see addrtrace.h) reports every heap word
+// it reads or writes and every payload it copies
+#ifdef MM_ADDR_TRACE
+#define GET(ptr) (addrtrace_access((ptr), WORDSIZE, 0), *(size_t *)(ptr))
+#define PUT(ptr, val) (addrtrace_access((ptr), WORDSIZE, 1), *(size_t *)(ptr) = (val))
+#define TRACE_COPY(dst, src, size) (addrtrace_range((src), (size), 0), addrtrace_range((dst), (size), 1))
+#define TRACE_FILL(dst, size) addrtrace_range((dst), (size), 1)
+#else
+#define GET(ptr) (*(size_t *)(ptr))
+#define PUT(ptr, val) (*(size_t *)(ptr) = (val))   
+#define TRACE_COPY(dst, src, size)
+#define TRACE_FILL(dst, size)
+#endif
+
+// Words that hold a free list link or root
+#define GET_PTR(ptr) ((void *)GET(ptr))
+#define PUT_PTR(ptr, val) PUT(ptr, (size_t)(val))
 
 #define GET_SIZE(ptr) (GET(ptr) & ~0x7)
 #define GET_IS_ALLOCATED(ptr) (GET(ptr) & 0x1)   
@@ -47,12 +94,97 @@
 #define NEXT_BLOCK_PTR(block_ptr) ((char *)(block_ptr) + GET_SIZE(((char *)(block_ptr) - WORDSIZE)))
 #define PREV_BLOCK_PTR(block_ptr) ((char *)(block_ptr) - GET_SIZE(((char *)(block_ptr) - DWORDSIZE))) 
 
+// Free block links, laid out as in the original allocator: next link, then prev link.
+// The header and next link are adjacent words, but a payload that starts a cache line
+// still puts them on different lines; free list walks only prefetch (see PREFETCH)
 #define PREV_PTR(ptr) ((void*)(ptr) + WORDSIZE)
 #define NEXT_PTR(ptr) ((void*)(ptr))
 
+// Start loading the header and next link of a free block that a free list walk visits next
+#if defined(__GNUC__)
+#define PREFETCH(block_ptr) (__builtin_prefetch(HEADER_PTR(block_ptr)), __builtin_prefetch(NEXT_PTR(block_ptr)))
+#else
+#define PREFETCH(block_ptr)
+#endif
+
+// Definition of realloc growth prediction
+#define GROW_BIT 0x4 // Header bit of a block that has grown by realloc before
+#define GROWTH_SLOTS 64 // Entries of growth_table
+#define GROWTH_SLOT(block_ptr) (((size_t)(block_ptr) / DWORDSIZE) % GROWTH_SLOTS)
+#define GROWTH_STEPS 3 // Slack doubles per growth until it reaches old size
+
+// Definition of cache line placement and thread spans
+#define CACHELINE 64 // Bytes of a cache line
+#define SPAN_BIT 0x2 // Header bit of an object carved from a thread span
+#define SPAN_SIZE PAGESIZE // Bytes of a span, first cache line holds span metadata
+#define SPAN_GRANULE 16 // Object blocks in a span are multiples of SPAN_GRANULE
+#define SPAN_CLASSES (CACHELINE / SPAN_GRANULE) // Object block sizes 16, 32, 48, 64
+#define SPAN_OBJECT_MAX (CACHELINE - WORDSIZE) // Largest payload served from a span, 56 bytes on LP64
+// Larger blocks come from the shared free lists, so blocks of 57 bytes and up of different threads can still share a line
+
+#define LAYOUT_BUFFER 256 // Runs mm_dump_layout collects before writing them
+
+#define ROUND_UP(size, unit) (((size) + (unit) - 1) / (unit) * (unit))
+
+#define IS_SPAN_OBJECT(ptr) (GET(HEADER_PTR(ptr)) & SPAN_BIT)
+#define SPAN_OBJECT_SIZE(ptr) (GET(HEADER_PTR(ptr)) & 0xfff8) // Block size of span object (header + payload)
+#define SPAN_OF(ptr) ((char *)HEADER_PTR(ptr) - (GET(HEADER_PTR(ptr)) >> 16)) // Span holding object, from offset in header
+
+#define SPAN_LIVE(span_ptr) ((char *)(span_ptr)) // Number of objects of span in use
+#define SPAN_RETIRED(span_ptr) ((char *)(span_ptr) + WORDSIZE) // Nonzero once owner thread moved to a new span
+#define SPAN_FREE_ROOT(span_ptr, span_class) ((char *)(span_ptr) + (2 + (span_class)) * WORDSIZE) // Freed objects of span class
+
+#define LOCK() do { if (threaded) pthread_mutex_lock(&heap_lock); } while (0)
+#define UNLOCK() do { if (threaded) pthread_mutex_unlock(&heap_lock); } while (0)
+
+// Segregated free lists, one per size class of sizeclass.h (make sizeclasses)
+#define ROOT_WORDS (NUM_SIZE_CLASSES | 1) // Roots padded to odd number of words to keep payloads double word aligned
+#define ROOT_PTR(size_class) ((char *)free_root + (size_class) * WORDSIZE)
+
+// Definition of placement policies (selected at compile time with -D)
+#define FIRST_FIT 0
+#define NEXT_FIT 1
+#define BEST_FIT 2
+
+#define LIFO_ORDER 0
+#define ADDRESS_ORDER 1
+
+#ifndef FIT_POLICY
+#define FIT_POLICY FIRST_FIT // Which free block find_fit returns
+#endif
+
+#ifndef INSERT_POLICY
+#define INSERT_POLICY LIFO_ORDER // Where insert_free_block puts a block in the free list
+#endif
+
+#ifndef SPLIT_THRESHOLD
+#define SPLIT_THRESHOLD (4 * DWORDSIZE) // Surplus size above which allocate splits a block
+#endif
+
 // Definition of global variable
 static void* heap_root;
-static void* free_root;
+static void* free_root; // Root of free list of size class 0, followed by the others
+#if FIT_POLICY == NEXT_FIT
+static void* rovers[NUM_SIZE_CLASSES]; // Free block of each size class where the next fit search resumes
+#endif
+
+// Growth history of recently grown blocks (see predict_size)
+static struct {
+    void* block_ptr;
+    unsigned int grows; // Number of times block has grown
+} growth_table[GROWTH_SLOTS];
+
+static mm_stats_t stats; // Event counts since mm_init (see mm_get_stats)
+
+// Definition of thread state (see mm_set_threaded)
+static int threaded; // Lock heap and carve small objects from per-thread spans
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int heap_generation; // Incremented by mm_init, invalidates every thread's span
+static __thread void* span_ptr; // Current span of this thread
+static __thread void* span_cursor; // Header of next object to carve from current span
+static __thread unsigned int span_generation; // heap_generation when current span was taken
+static pthread_key_t span_key; // Its destructor retires the span of an exiting thread
+static pthread_once_t span_key_once = PTHREAD_ONCE_INIT;
 
 // Definition of debug functions
 static int is_all_marked_free();
@@ -68,8 +200,23 @@ static void* extend_heap(size_t number_of_words);
 static void* coalesce(void* block_ptr);
 static void insert_free_block(void* block_ptr);
 static void delete_free_block(void* block_ptr);
-static void* first_fit(size_t size);
+static void* find_fit(size_t size);
 static void allocate(void* block_ptr, size_t size);
+static void* malloc_block(size_t size);
+static void free_block(void* ptr);
+static void* realloc_block(void* ptr, size_t size);
+static size_t predict_size(void* ptr, size_t old_size, size_t block_size);
+static void move_growth(void* old_ptr, void* new_ptr);
+
+// Definition of cache line and thread span functions
+static void* malloc_aligned_block(size_t block_size, size_t alignment);
+static void* malloc_cacheline_block(size_t size);
+static void* span_malloc(size_t size);
+static void span_free(void* ptr);
+static void* span_realloc(void* ptr, size_t size);
+static void* span_adopt(void* ptr, size_t size);
+static void span_thread_exit(void* span);
+static void make_span_key(void);
 
 static int is_all_marked_free() {
     /*
@@ -84,14 +231,17 @@ static int is_all_marked_free() {
     */
     
     int flag = 1 << 0;
+    int size_class;
     void* block_ptr;
 
-    // Walk free list
-    for(block_ptr = GET(free_root); block_ptr != NULL; block_ptr = GET(NEXT_PTR(block_ptr))){
-        if(GET_IS_ALLOCATED(HEADER_PTR(block_ptr)) == FREE && GET_IS_ALLOCATED(FOOTER_PTR(block_ptr)) == FREE) // Current block is marked as free
-            continue;
-        // Current block is marked as allocated
-        return 0;
+    // Walk free list of every size class
+    for(size_class = 0; size_class < NUM_SIZE_CLASSES; size_class++) {
+        for(block_ptr = GET_PTR(ROOT_PTR(size_class)); block_ptr != NULL; block_ptr = GET_PTR(NEXT_PTR(block_ptr))){
+            if(GET_IS_ALLOCATED(HEADER_PTR(block_ptr)) == FREE && GET_IS_ALLOCATED(FOOTER_PTR(block_ptr)) == FREE) // Current block is marked as free
+                continue;
+            // Current block is marked as allocated
+            return 0;
+        }
     }
 
     return flag;
@@ -109,16 +259,16 @@ static int is_contiguous_not_escaped() {
     */
     
     int flag = 1 << 1;
+    int size_class;
     void* block_ptr;
     
-    // Walk free list
-    for(block_ptr = GET(free_root); block_ptr != NULL; block_ptr = GET(NEXT_PTR(block_ptr))) {
-        if(NEXT_BLOCK_PTR(block_ptr) != NULL) { // Next block exists
+    // Walk free list of every size class
+    for(size_class = 0; size_class < NUM_SIZE_CLASSES; size_class++) {
+        for(block_ptr = GET_PTR(ROOT_PTR(size_class)); block_ptr != NULL; block_ptr = GET_PTR(NEXT_PTR(block_ptr))) {
+            // Prologue and epilogue are allocated, so every free block has both neighbors
             if(GET_IS_ALLOCATED(HEADER_PTR(NEXT_BLOCK_PTR(block_ptr))) == FREE) // Next block is free
                 return 0; // Current block and Next block is not coalesced
-        }
-        
-        if(PREV_BLOCK_PTR(block_ptr) != NULL) { // Previous block exists
+
             if(GET_IS_ALLOCATED(HEADER_PTR(PREV_BLOCK_PTR(block_ptr))) == FREE) // Previous block is free
                 return 0; // Previous block and Current block is not coalesced
         }
@@ -144,13 +294,13 @@ static int is_all_free_block_in_list() {
     void* temp_ptr;
 
     // Walk heap
-    for (block_ptr = heap_root; block_ptr != NULL; block_ptr = GET(NEXT_BLOCK_PTR(block_ptr))) {
+    for (block_ptr = heap_root; block_ptr != NULL; block_ptr = GET_PTR(NEXT_BLOCK_PTR(block_ptr))) {
         if (GET_IS_ALLOCATED(HEADER_PTR(block_ptr)) == FREE) { // Current block is free
-            temp_ptr = GET(free_root); // Start from first free block
+            temp_ptr = GET_PTR(ROOT_PTR(SIZE_CLASS(GET_SIZE(HEADER_PTR(block_ptr))))); // Start from first free block of its size class
             while(temp_ptr != NULL){
                 if(temp_ptr == block_ptr) // Current block exsits in free list
                     break;
-                temp_ptr = GET(NEXT_PTR(temp_ptr)); // Move to next free block
+                temp_ptr = GET_PTR(NEXT_PTR(temp_ptr)); // Move to next free block
             }
             
             if (temp_ptr == NULL) // Current block does not exist in free list
@@ -179,7 +329,7 @@ static int is_all_valid_free_ptr() {
     // Walk heap
     for (block_ptr = NEXT_BLOCK_PTR(heap_root); block_ptr < mem_heap_hi(); block_ptr = NEXT_BLOCK_PTR(block_ptr)) {
         if (GET_IS_ALLOCATED(HEADER_PTR(block_ptr)) == FREE){ // Current block is free block
-            if(!(mem_heap_lo() <= HEADER_PTR(block_ptr) && FOOTER_PTR(block_ptr) <= mem_heap_hi()) || (GET(HEADER_PTR(block_ptr)) & 0x6 != 0)) // block is not in heap, or not 8-byte aligned
+            if(!((char *)mem_heap_lo() <= HEADER_PTR(block_ptr) && FOOTER_PTR(block_ptr) <= (char *)mem_heap_hi()) || (GET_SIZE(HEADER_PTR(block_ptr)) & (DWORDSIZE - 1)) != 0) // block is not in heap, or size not double word aligned
                 return 0;
         }
     }
@@ -206,13 +356,11 @@ static int is_no_overlap() {
         if(GET_IS_ALLOCATED(HEADER_PTR(block_ptr)) == FREE) // Current block is free block
             continue; // Pass
         
-        if(NEXT_BLOCK_PTR(block_ptr) != NULL){
-            if(GET_IS_ALLOCATED(HEADER_PTR(NEXT_BLOCK_PTR(block_ptr))) == FREE) // Next block is free block
-                continue; // Pass
-            
-            if(FOOTER_PTR(block_ptr) > HEADER_PTR(NEXT_BLOCK_PTR(block_ptr))) // Current block and Next block is overlapped
-                return 0;
-        }
+        if(GET_IS_ALLOCATED(HEADER_PTR(NEXT_BLOCK_PTR(block_ptr))) == FREE) // Next block is free block
+            continue; // Pass
+
+        if(FOOTER_PTR(block_ptr) > HEADER_PTR(NEXT_BLOCK_PTR(block_ptr))) // Current block and Next block is overlapped
+            return 0;
     }
 
     return flag;
@@ -235,7 +383,7 @@ static int is_all_valid_allocated_ptr(){
     // Walk heap
     for (block_ptr=NEXT_BLOCK_PTR(heap_root); block_ptr < mem_heap_hi(); block_ptr = NEXT_BLOCK_PTR(block_ptr)) {
         if (GET_IS_ALLOCATED(HEADER_PTR(block_ptr)) == ALLOCATED){ // Current block is allocated block
-            if(!(mem_heap_lo() <= HEADER_PTR(block_ptr) && FOOTER_PTR(block_ptr) <= mem_heap_hi()) || (GET(HEADER_PTR(block_ptr)) & 0x6 != 0)) // block is not in heap, or not 8-byte aligned
+            if(!((char *)mem_heap_lo() <= HEADER_PTR(block_ptr) && FOOTER_PTR(block_ptr) <= (char *)mem_heap_hi()) || (GET_SIZE(HEADER_PTR(block_ptr)) & (DWORDSIZE - 1)) != 0) // block is not in heap, or size not double word aligned
                 return 0;
         }
     }
@@ -284,7 +432,7 @@ static void* extend_heap(size_t number_of_words) {
     void* block_ptr;
     size_t size;
 
-    // Align size to ever number (8-byte aligning)
+    // Align size to ever number (double word aligning)
     size = (number_of_words % 2 == 0) ? number_of_words * WORDSIZE : (number_of_words + 1) * WORDSIZE;
 
     // Allocate space
@@ -292,10 +440,11 @@ static void* extend_heap(size_t number_of_words) {
 
     if ((long) block_ptr == -1) // Failed to allocate space
         return NULL;
+    stats.extend_heaps++;
     
     // Initialize free block
-    PUT(NEXT_PTR(block_ptr), NULL); // Next pointer of current block
-    PUT(PREV_PTR(block_ptr), NULL); // Prev pointer of current block
+    PUT_PTR(NEXT_PTR(block_ptr), NULL); // Next pointer of current block
+    PUT_PTR(PREV_PTR(block_ptr), NULL); // Prev pointer of current block
     PUT(HEADER_PTR(block_ptr), size | FREE); // Header of current block
     PUT(FOOTER_PTR(block_ptr), size | FREE); // Footer of current block
     PUT(HEADER_PTR(NEXT_BLOCK_PTR(block_ptr)), 0 | ALLOCATED); // New epilogue header for new free block
@@ -381,7 +530,8 @@ static void* coalesce(void* block_ptr) {
 
 static void insert_free_block(void* block_ptr) {
     /*
-    The function that inserts current block to first block of free list (LIFO policy)
+    The function that inserts current block to free list.
+    LIFO_ORDER inserts it as first block, ADDRESS_ORDER keeps the list sorted by address.
 
     Args:
         void* block_ptr: Pointer of current block
@@ -390,15 +540,31 @@ static void insert_free_block(void* block_ptr) {
         void: None
     */
 
-    void* first_block_ptr = GET(free_root); // First block of free list
+    void* root_ptr = ROOT_PTR(SIZE_CLASS(GET_SIZE(HEADER_PTR(block_ptr)))); // Root of free list of current block's size class
+    void* prev_block_ptr = NULL; // Block that will precede current block
+    void* next_block_ptr = GET_PTR(root_ptr); // Block that will follow current block
+
+    stats.free_bytes += GET_SIZE(HEADER_PTR(block_ptr));
+    stats.free_blocks++;
 
-    if (first_block_ptr != NULL)
-        PUT(PREV_PTR(first_block_ptr), block_ptr); // Current block is first block's previous block
+#if INSERT_POLICY == ADDRESS_ORDER
+    // Walk free list until the first block above current block
+    while (next_block_ptr != NULL && next_block_ptr < block_ptr) {
+        prev_block_ptr = next_block_ptr;
+        next_block_ptr = GET_PTR(NEXT_PTR(next_block_ptr));
+    }
+#endif
+
+    if (next_block_ptr != NULL)
+        PUT_PTR(PREV_PTR(next_block_ptr), block_ptr); // Current block is next block's previous block
     
-    PUT(NEXT_PTR(block_ptr), first_block_ptr); // First block is current block's next block
-    PUT(PREV_PTR(block_ptr), NULL); // Previous block of current block is NULL
+    PUT_PTR(NEXT_PTR(block_ptr), next_block_ptr); // Next block is current block's next block
+    PUT_PTR(PREV_PTR(block_ptr), prev_block_ptr); // Previous block is current block's previous block
 
-    PUT(free_root, block_ptr); // Current block is now first block of free list
+    if (prev_block_ptr != NULL)
+        PUT_PTR(NEXT_PTR(prev_block_ptr), block_ptr); // Current block is previous block's next block
+    else
+        PUT_PTR(root_ptr, block_ptr); // Current block is now first block of free list
     
     return;
 }
@@ -414,38 +580,51 @@ static void delete_free_block(void* block_ptr) {
         void: None
     */
 
-    void* prev_ptr = GET(PREV_PTR(block_ptr)); // Pointer of previous block
-    void* next_ptr = GET(NEXT_PTR(block_ptr)); // Pointer of next block
+    int size_class = SIZE_CLASS(GET_SIZE(HEADER_PTR(block_ptr))); // Size class of current block
+    void* prev_ptr = GET_PTR(PREV_PTR(block_ptr)); // Pointer of previous block
+    void* next_ptr = GET_PTR(NEXT_PTR(block_ptr)); // Pointer of next block
+
+    stats.free_bytes -= GET_SIZE(HEADER_PTR(block_ptr));
+    stats.free_blocks--;
+
+#if FIT_POLICY == NEXT_FIT
+    if (rovers[size_class] == block_ptr) // Resume next search after current block
+        rovers[size_class] = next_ptr;
+#endif
 
     // Link previous block and next block if needed
 
     if (prev_ptr != NULL && next_ptr != NULL) {
-        PUT(PREV_PTR(next_ptr), prev_ptr); // Previous block of next block is previous block
-        PUT(NEXT_PTR(prev_ptr), next_ptr); // Next block of previous block is next block
+        PUT_PTR(PREV_PTR(next_ptr), prev_ptr); // Previous block of next block is previous block
+        PUT_PTR(NEXT_PTR(prev_ptr), next_ptr); // Next block of previous block is next block
     }
 
     else if (prev_ptr != NULL && next_ptr == NULL) {
-        PUT(NEXT_PTR(prev_ptr), next_ptr); // Next block of previous block is next block
+        PUT_PTR(NEXT_PTR(prev_ptr), next_ptr); // Next block of previous block is next block
     }
 
     else if (prev_ptr == NULL && next_ptr != NULL) {
-        PUT(PREV_PTR(next_ptr), NULL); // Previous block of next block is NULL
-        PUT(free_root, next_ptr); // First block of free list is next block
+        PUT_PTR(PREV_PTR(next_ptr), NULL); // Previous block of next block is NULL
+        PUT_PTR(ROOT_PTR(size_class), next_ptr); // First block of free list is next block
     }
 
     else if (prev_ptr == NULL && next_ptr == NULL) {
-        PUT(free_root, NULL); // First block of free list is next block
+        PUT_PTR(ROOT_PTR(size_class), NULL); // First block of free list is next block
     }
 
-    PUT(NEXT_PTR(block_ptr), NULL); // Previous block of current block is NULL
-    PUT(PREV_PTR(block_ptr), NULL); // Next block of current block is NULL
+    PUT_PTR(NEXT_PTR(block_ptr), NULL); // Previous block of current block is NULL
+    PUT_PTR(PREV_PTR(block_ptr), NULL); // Next block of current block is NULL
     
     return;
 }
 
-static void* first_fit(size_t size) {
+static void* find_fit(size_t size) {
     /*
-    The function that finds first free block that fits size
+    The function that finds free block that fits size according to FIT_POLICY.
+    Free lists are searched from the size class of size upwards.
+    FIRST_FIT returns the first fitting block of a free list,
+    NEXT_FIT the first fitting block after the previous search,
+    BEST_FIT the smallest fitting block.
 
     Args:
         size_t size: Size of block to find
@@ -455,13 +634,61 @@ static void* first_fit(size_t size) {
 
     */
 
+    int size_class;
     void* block_ptr;
+    void* next_block_ptr; // Next block of free list, loaded before current block is tested
+#if FIT_POLICY == BEST_FIT
+    void* best_block_ptr; // Smallest fitting block so far
+    size_t best_size = 0; // Size of smallest fitting block so far
+    size_t block_size;
+#endif
+
+    for(size_class = SIZE_CLASS(size); size_class < NUM_SIZE_CLASSES; size_class++){ // Every block of a larger class fits size
+#if FIT_POLICY == NEXT_FIT
+        // Search from rover to end of free list
+        for(block_ptr = rovers[size_class]; block_ptr != NULL; block_ptr = next_block_ptr){
+            next_block_ptr = GET_PTR(NEXT_PTR(block_ptr));
+            PREFETCH(next_block_ptr); // Overlap next miss with testing current block
+            if(size <= GET_SIZE(HEADER_PTR(block_ptr))) // Current block fits size
+                return rovers[size_class] = block_ptr;
+        }
 
-    for(block_ptr = GET(free_root); block_ptr != NULL; block_ptr = GET(NEXT_PTR(block_ptr))){ // Start from first free block, end if free block is NULL, current block is next block
-        if(size > GET_SIZE(HEADER_PTR(block_ptr))) // Current block does not fit size
-            continue; // Pass
+        // Wrap around and search from first free block to rover
+        for(block_ptr = GET_PTR(ROOT_PTR(size_class)); block_ptr != rovers[size_class]; block_ptr = next_block_ptr){
+            next_block_ptr = GET_PTR(NEXT_PTR(block_ptr));
+            PREFETCH(next_block_ptr); // Overlap next miss with testing current block
+            if(size <= GET_SIZE(HEADER_PTR(block_ptr))) // Current block fits size
+                return rovers[size_class] = block_ptr;
+        }
+
+#elif FIT_POLICY == BEST_FIT
+        best_block_ptr = NULL;
+        for(block_ptr = GET_PTR(ROOT_PTR(size_class)); block_ptr != NULL; block_ptr = next_block_ptr){
+            next_block_ptr = GET_PTR(NEXT_PTR(block_ptr));
+            PREFETCH(next_block_ptr); // Overlap next miss with testing current block
+            block_size = GET_SIZE(HEADER_PTR(block_ptr));
+            if(size > block_size || (best_block_ptr != NULL && block_size >= best_size)) // Current block does not fit size or is not better
+                continue; // Pass
+
+            best_block_ptr = block_ptr;
+            best_size = block_size;
+            if(block_size == size) // Exact fit can not be beaten
+                break;
+        }
+
+        if(best_block_ptr != NULL) // Blocks of larger classes are larger
+            return best_block_ptr;
+
+#else
+        for(block_ptr = GET_PTR(ROOT_PTR(size_class)); block_ptr != NULL; block_ptr = next_block_ptr){ // Start from first free block, end if free block is NULL, current block is next block
+            next_block_ptr = GET_PTR(NEXT_PTR(block_ptr));
+            PREFETCH(next_block_ptr); // Overlap next miss with testing current block
+            if(size > GET_SIZE(HEADER_PTR(block_ptr))) // Current block does not fit size
+                continue; // Pass
 
-        return block_ptr; // Current block fits size
+            return block_ptr; // Current block fits size
+        }
+#endif
     }
 
     return NULL; // No fitting free block found
@@ -486,7 +713,7 @@ static void allocate(void* block_ptr, size_t size) {
 
     delete_free_block(block_ptr); // Delete current block from free list to allocate
     
-    if (surplus_size <= 4 * DWORDSIZE){ // If fragmentaion is not severe
+    if (surplus_size <= SPLIT_THRESHOLD){ // If fragmentaion is not severe
         // Allocate anyway
         PUT(HEADER_PTR(block_ptr), free_block_size | ALLOCATED); // Header of current block
         PUT(FOOTER_PTR(block_ptr), free_block_size | ALLOCATED); // Footer of current block
@@ -499,8 +726,8 @@ static void allocate(void* block_ptr, size_t size) {
     
     // Divid the free block to allocate block and surplus block
     surplus_block_ptr = NEXT_BLOCK_PTR(block_ptr); // Get surplus block
-    PUT(NEXT_PTR(surplus_block_ptr), NULL); // Next block is NULL
-    PUT(PREV_PTR(surplus_block_ptr), NULL); // Previous block is NULL
+    PUT_PTR(NEXT_PTR(surplus_block_ptr), NULL); // Next block is NULL
+    PUT_PTR(PREV_PTR(surplus_block_ptr), NULL); // Previous block is NULL
     PUT(HEADER_PTR(surplus_block_ptr), surplus_size | FREE); // Header of surplus block
     PUT(FOOTER_PTR(surplus_block_ptr), surplus_size | FREE); // Footer of surplus block
     
@@ -526,20 +753,28 @@ int mm_init(void)
     
     */
 
-    heap_root = mem_sbrk(6 * WORDSIZE); // Allocate space of unused padding, prologue, epilogue
+    int size_class;
+
+    heap_root = mem_sbrk((ROOT_WORDS + 3) * WORDSIZE); // Allocate space of free list roots, prologue, epilogue
     
-    if (heap_root == (void*) -1) // Failed to allocate unused padding, prologue, epilogue 
+    if (heap_root == (void*) -1) // Failed to allocate free list roots, prologue, epilogue 
         return -1;
     
-    PUT(heap_root, 0); // Unused padding
-    PUT(heap_root + 1 * WORDSIZE, NULL); // Next pointer of free
-    PUT(heap_root + 2 * WORDSIZE, NULL); // Prev pointer of free
-    PUT(heap_root + 3 * WORDSIZE, 2 * WORDSIZE | ALLOCATED); // Prologue header
-    PUT(heap_root + 4 * WORDSIZE, 2 * WORDSIZE | ALLOCATED); // Prologue footer
-    PUT(heap_root + 5 * WORDSIZE, 0 * WORDSIZE | ALLOCATED); // Epilogue header
+    for (size_class = 0; size_class < ROOT_WORDS; size_class++)
+        PUT_PTR(heap_root + size_class * WORDSIZE, NULL); // Empty free list (or unused padding)
+    PUT(heap_root + (ROOT_WORDS + 0) * WORDSIZE, 2 * WORDSIZE | ALLOCATED); // Prologue header
+    PUT(heap_root + (ROOT_WORDS + 1) * WORDSIZE, 2 * WORDSIZE | ALLOCATED); // Prologue footer
+    PUT(heap_root + (ROOT_WORDS + 2) * WORDSIZE, 0 * WORDSIZE | ALLOCATED); // Epilogue header
     
-    free_root = heap_root + 2 * WORDSIZE; // Make root of free list point to Prev pointer of prologue
-    heap_root += 4 * WORDSIZE; // Move root of heap between Prologue and Epilogue
+    free_root = heap_root; // Make root of free lists point to first root
+    heap_generation++; // Spans of the old heap are gone
+    memset(growth_table, 0, sizeof(growth_table)); // Forget growth history of old heap
+    memset(&stats, 0, sizeof(stats)); // Count events of new heap
+    heap_root += (ROOT_WORDS + 1) * WORDSIZE; // Move root of heap between Prologue and Epilogue
+#if FIT_POLICY == NEXT_FIT
+    for (size_class = 0; size_class < NUM_SIZE_CLASSES; size_class++)
+        rovers[size_class] = NULL; // Start next fit search from first free block
+#endif
     
     if (extend_heap(PAGESIZE / WORDSIZE) == NULL) // Failed to allocate 
         return -1;
@@ -547,15 +782,9 @@ int mm_init(void)
     return 0;
 }
 
-/* 
- * mm_malloc - Allocate a block by incrementing the brk pointer.
- *     Always allocate a block whose size is a multiple of the alignment.
- */
-
-void *mm_malloc(size_t size)
-{
+static void* malloc_block(size_t size) {
     /*
-    The function that allocates block by incrementing the brk pointer.
+    The function that allocates block from free lists, or by extending heap.
     Always allocate a block whose size is a multiple of the alignment.
 
     Args:
@@ -584,11 +813,11 @@ void *mm_malloc(size_t size)
             return NULL;
     }
 
-    // 8-byte aligning
+    // Double word aligning
     block_size = ALIGN(size) + 2 * WORDSIZE; // Add header, footer space
 
-    // Do first fit search
-    block_ptr = first_fit(block_size);
+    // Search free list according to FIT_POLICY
+    block_ptr = find_fit(block_size);
     
     if (block_ptr == NULL) { // No fitting free block found
         extension_size = block_size > PAGESIZE ? block_size : PAGESIZE; // Extend heap by block_size or PAGESIZE (maximum)
@@ -603,14 +832,9 @@ void *mm_malloc(size_t size)
     return block_ptr;
 }
 
-
-/*
- * mm_free - Freeing a block does nothing.
- */
-void mm_free(void *ptr)
-{
+static void free_block(void* ptr) {
     /*
-    The function that frees a block does nothing.
+    The function that frees a block and coalesces it with free neighbors.
 
     Args:
         void* ptr: Pointer of block to free
@@ -623,8 +847,8 @@ void mm_free(void *ptr)
     size_t size = GET_SIZE(HEADER_PTR(ptr)); // Size of current block
     
     // Initialize free block
-    PUT(NEXT_PTR(ptr), NULL) ; // Next block is NULL
-    PUT(PREV_PTR(ptr), NULL); // Previous block is NULL
+    PUT_PTR(NEXT_PTR(ptr), NULL) ; // Next block is NULL
+    PUT_PTR(PREV_PTR(ptr), NULL); // Previous block is NULL
     PUT(HEADER_PTR(ptr), size | FREE); // Header of current block
     PUT(FOOTER_PTR(ptr), size | FREE); // Footer of current block
 
@@ -634,14 +858,12 @@ void mm_free(void *ptr)
     return;
 }
 
-/*
- * mm_realloc - Implemented simply in terms of mm_malloc and mm_free
- */
-void *mm_realloc(void *ptr, size_t size)
-{   
+static void* realloc_block(void* ptr, size_t size) {
     /*
-    The function that reallocates block to larger size if possible.
-    And allocates new block if not possible.
+    The function that reallocates block to larger size in place if possible,
+    by absorbing a free next block or extending heap at the end of heap.
+    And moves block to new block if not possible.
+    Blocks that keep growing get geometric slack (see predict_size).
 
     Args: 
         void* ptr: Pointer of block to realloc
@@ -652,62 +874,826 @@ void *mm_realloc(void *ptr, size_t size)
     
     */
 
-    void* next_block_ptr = NEXT_BLOCK_PTR(ptr); // Pointer of next block
+    void* next_block_ptr;
     void* newptr;
-    void* surplus_block_ptr;
-    
-    size_t is_next_allocated = GET_IS_ALLOCATED(HEADER_PTR(NEXT_BLOCK_PTR(ptr))); // Locate header of next block and extract allocation bit
+    size_t is_next_allocated;
+    size_t block_size; // Size of block needed, with header and footer
     size_t old_size;
     size_t next_size;
-    size_t allocate_size;
+    size_t shortfall; // Size missing after absorbing free next block
 
     if (ptr == NULL) // Allocate if ptr is NULL
-        return mm_malloc(size);
+        return malloc_block(size);
 
     if (size == 0) { // free block if size is 0
-        mm_free(ptr);
+        free_block(ptr);
         return NULL;
     }
 
-    size = ALIGN(size) + 2 * WORDSIZE; // Add header, footer space
+    block_size = ALIGN(size) + 2 * WORDSIZE; // Add header, footer space
     old_size = GET_SIZE(HEADER_PTR(ptr)); // Size of current block
-    next_size = GET_SIZE(HEADER_PTR(NEXT_BLOCK_PTR(ptr))); // Size of next block
 
-    if (size > old_size) { // Realloc to larger size
-        if (next_size >= size - old_size && !is_next_allocated) { // Next block is free and has enough space
-            delete_free_block(next_block_ptr); // Delete next block from free list
-            
-            PUT(HEADER_PTR(ptr), old_size + next_size | ALLOCATED); // Header of current block
-            PUT(FOOTER_PTR(ptr), old_size + next_size | ALLOCATED); // Footer of current block
-            
-            return ptr;
+    if (block_size <= old_size) // Block still fits (shrinking keeps block)
+        return ptr;
+
+    // Realloc to larger size
+    block_size = predict_size(ptr, old_size, block_size);
+    next_block_ptr = NEXT_BLOCK_PTR(ptr); // Pointer of next block
+    is_next_allocated = GET_IS_ALLOCATED(HEADER_PTR(next_block_ptr)); // Locate header of next block and extract allocation bit
+    next_size = is_next_allocated ? 0 : GET_SIZE(HEADER_PTR(next_block_ptr)); // Size of free next block
+
+    if (old_size + next_size < block_size) { // Not enough space behind block
+        if (next_size != 0) // Look behind free next block
+            next_block_ptr = NEXT_BLOCK_PTR(next_block_ptr);
+
+        if (GET_SIZE(HEADER_PTR(next_block_ptr)) == 0) { // Block (and free next block) ends heap
+            // Extend heap by missing size, extended space coalesces into next block
+            shortfall = block_size - (old_size + next_size);
+            shortfall = shortfall > 2 * DWORDSIZE ? shortfall : 2 * DWORDSIZE; // Smallest free block
+            if (extend_heap(shortfall / WORDSIZE) == NULL) // Failed to extend heap
+                return NULL;
         }
+        else { // Next block is allocated or too small
+            // Move payload to new block
+            newptr = malloc_block(block_size - 2 * WORDSIZE);
+            if (newptr == NULL) // Failed to allocate
+                return NULL;
+            TRACE_COPY(newptr, ptr, old_size - 2 * WORDSIZE);
+            memcpy(newptr, ptr, old_size - 2 * WORDSIZE); // Move payload to new block
+            free_block(ptr); // Free old block
+            move_growth(ptr, newptr);
+            stats.realloc_copies++;
 
-        else if (next_size < size - old_size && !is_next_allocated) { // Next block is free but does not have enough space
-            
-            // Try to extend heap
-            allocate_size = size - (old_size + next_size) > PAGESIZE ? size - (old_size + next_size) : PAGESIZE;
-            if (extend_heap(allocate_size / PAGESIZE) == NULL) {
-                return NULL; // Extend heap failed
-            }
-            size += allocate_size; // Update size
-            delete_free_block(next_block_ptr); // Delete next block from free list
-            PUT(HEADER_PTR(ptr), size | ALLOCATED); // Header of current block
-            PUT(FOOTER_PTR(ptr), size | ALLOCATED); // Footer of current block
+            return newptr;
+        }
+    }
+
+    // Absorb free next block
+    next_block_ptr = NEXT_BLOCK_PTR(ptr);
+    next_size = GET_SIZE(HEADER_PTR(next_block_ptr));
+    delete_free_block(next_block_ptr); // Delete next block from free list
+
+    if (old_size + next_size - block_size <= SPLIT_THRESHOLD) // If fragmentaion is not severe
+        block_size = old_size + next_size; // Absorb it whole
+
+    PUT(HEADER_PTR(ptr), block_size | GROW_BIT | ALLOCATED); // Header of current block
+    PUT(FOOTER_PTR(ptr), block_size | GROW_BIT | ALLOCATED); // Footer of current block
+
+    if (old_size + next_size > block_size) { // Return surplus
+        next_block_ptr = NEXT_BLOCK_PTR(ptr);
+        PUT(HEADER_PTR(next_block_ptr), (old_size + next_size - block_size) | FREE); // Header of surplus block
+        PUT(FOOTER_PTR(next_block_ptr), (old_size + next_size - block_size) | FREE); // Footer of surplus block
+        coalesce(next_block_ptr);
+    }
+    stats.realloc_inplace++;
+
+    return ptr;
+}
+
+static size_t predict_size(void* ptr, size_t old_size, size_t block_size) {
+    /*
+    The function that predicts the size a growing block will need.
+    GROW_BIT in header marks a block that has grown before, and growth_table counts its growths.
+    The first growth gets no slack; the 2nd, 3rd and later growths get old_size / 4, old_size / 2, then old_size,
+    so repeated small growths move or extend the block O(log n) times.
+
+    Args:
+        void* ptr: Pointer of growing block
+        size_t old_size: Current size of block
+        size_t block_size: Size needed now
+
+    Returns:
+        size_t block_size: Size to allocate, with slack
+    */
+
+    int slot = GROWTH_SLOT(ptr);
+    unsigned int grows = 0; // Previous growths of block
+
+    if (GET(HEADER_PTR(ptr)) & GROW_BIT) // Block has grown before
+        grows = growth_table[slot].block_ptr == ptr ? growth_table[slot].grows : 1; // Entry may have been evicted
+
+    growth_table[slot].block_ptr = ptr; // Record this growth
+    growth_table[slot].grows = grows + 1;
+
+    if (grows == 0) // First growth gives no hint yet
+        return block_size;
+
+    grows = grows < GROWTH_STEPS ? grows : GROWTH_STEPS;
+    return ALIGN(block_size + (old_size >> (GROWTH_STEPS - grows)));
+}
+
+static void move_growth(void* old_ptr, void* new_ptr) {
+    /*
+    The function that moves growth history of block to the block its payload moved to.
+
+    Args:
+        void* old_ptr: Pointer of old block
+        void* new_ptr: Pointer of new block
+
+    Returns:
+        void: None
+    */
+
+    int old_slot = GROWTH_SLOT(old_ptr);
+    int new_slot = GROWTH_SLOT(new_ptr);
+    unsigned int grows = growth_table[old_slot].block_ptr == old_ptr ? growth_table[old_slot].grows : 1;
+
+    if (growth_table[old_slot].block_ptr == old_ptr) // Old block is gone
+        growth_table[old_slot].block_ptr = NULL;
+
+    growth_table[new_slot].block_ptr = new_ptr;
+    growth_table[new_slot].grows = grows;
+
+    PUT(HEADER_PTR(new_ptr), GET(HEADER_PTR(new_ptr)) | GROW_BIT); // Header of new block
+    PUT(FOOTER_PTR(new_ptr), GET(FOOTER_PTR(new_ptr)) | GROW_BIT); // Footer of new block
+
+    return;
+}
+
+static void* malloc_aligned_block(size_t block_size, size_t alignment) {
+    /*
+    The function that allocates block of block_size bytes whose payload is aligned to alignment.
+    Allocates a larger block and returns its unaligned head and its tail to free lists.
+
+    Args:
+        size_t block_size: Size of block (header, payload and footer), a multiple of DWORDSIZE
+        size_t alignment: Alignment of payload, a power of two larger than DWORDSIZE
+
+    Returns:
+        void* block_ptr: Pointer of allocated block, aligned to alignment
+    */
 
-            return ptr;
+    size_t raw_size; // Size of allocated block before trimming
+    size_t lead_size; // Size of unaligned head
+    size_t trail_size; // Size of tail behind aligned block
+    void* raw_ptr; // Pointer of allocated block before trimming
+    void* block_ptr;
+    void* trail_ptr;
+
+    raw_ptr = malloc_block(block_size + 2 * alignment - 2 * WORDSIZE); // Leave room for any alignment of raw block
+    if (raw_ptr == NULL) // Failed to allocate
+        return NULL;
+    raw_size = GET_SIZE(HEADER_PTR(raw_ptr));
+
+    // Align payload, head must be empty or large enough for a free block
+    block_ptr = (void*)ROUND_UP((size_t)raw_ptr, alignment);
+    lead_size = (char*)block_ptr - (char*)raw_ptr;
+    if (lead_size != 0 && lead_size < 2 * DWORDSIZE) {
+        block_ptr = (char*)block_ptr + alignment;
+        lead_size += alignment;
+    }
+
+    trail_size = raw_size - lead_size - block_size;
+    if (trail_size < 2 * DWORDSIZE) { // Tail too small for a free block
+        block_size += trail_size; // Absorb tail
+        trail_size = 0;
+    }
+
+    PUT(HEADER_PTR(block_ptr), block_size | ALLOCATED); // Header of aligned block
+    PUT(FOOTER_PTR(block_ptr), block_size | ALLOCATED); // Footer of aligned block
+
+    if (trail_size != 0) { // Return tail
+        trail_ptr = NEXT_BLOCK_PTR(block_ptr);
+        PUT(HEADER_PTR(trail_ptr), trail_size | FREE); // Header of tail block
+        PUT(FOOTER_PTR(trail_ptr), trail_size | FREE); // Footer of tail block
+        coalesce(trail_ptr);
+    }
+
+    if (lead_size != 0) { // Return head
+        PUT(HEADER_PTR(raw_ptr), lead_size | FREE); // Header of head block
+        PUT(FOOTER_PTR(raw_ptr), lead_size | FREE); // Footer of head block
+        coalesce(raw_ptr);
+    }
+
+    return block_ptr;
+}
+
+static void* malloc_cacheline_block(size_t size) {
+    /*
+    The function that allocates block whose payload starts a cache line and covers whole cache lines,
+    so that no other block has payload on them.
+
+    Args:
+        size_t size: Size of payload
+
+    Returns:
+        void* block_ptr: Pointer of allocated block, aligned to CACHELINE
+    */
+
+    if (size == 0) // Nothing to allocate
+        return NULL;
+
+    return malloc_aligned_block(ROUND_UP(size, CACHELINE) + CACHELINE, CACHELINE); // Payload lines, then a line for footer and next header
+}
+
+static void* span_malloc(size_t size) {
+    /*
+    The function that carves small object from the span of calling thread.
+    A span is a cache line aligned block owned by one thread, and its objects are only handed to that thread,
+    so a cache line never holds objects of different threads.
+    Object header holds its size, SPAN_BIT and the offset of its header from the span.
+
+    Args:
+        size_t size: Size of payload, at most SPAN_OBJECT_MAX
+
+    Returns:
+        void* block_ptr: Pointer of allocated object
+    */
+
+    size_t object_size = ROUND_UP(size + WORDSIZE, SPAN_GRANULE); // Header and payload
+    int span_class = object_size / SPAN_GRANULE - 1; // Free list of span to use
+    int i;
+    void* block_ptr;
+
+    if (size == 0) // Nothing to allocate
+        return NULL;
+
+    if (span_generation != heap_generation) // Span belongs to an old heap
+        span_ptr = NULL;
+
+    if (span_ptr != NULL) {
+        block_ptr = GET_PTR(SPAN_FREE_ROOT(span_ptr, span_class));
+        if (block_ptr != NULL) { // Reuse object freed to current span
+            PUT(SPAN_FREE_ROOT(span_ptr, span_class), GET(NEXT_PTR(block_ptr)));
+            PUT(SPAN_LIVE(span_ptr), GET(SPAN_LIVE(span_ptr)) + 1);
+            return block_ptr;
         }
 
-        else{ // Next block is allocated or does not exist
-            // Allocate to new block
-            newptr = mm_malloc(size);
-            allocate(newptr, size); // Allocate new block
-            memcpy(newptr, ptr, size); // Move payload to new block
-            mm_free(ptr); // Free old blocks
+        if ((char*)span_cursor + object_size > (char*)span_ptr + SPAN_SIZE) { // Current span is used up
+            PUT(SPAN_RETIRED(span_ptr), 1); // Span is freed with its last object
+            if (GET(SPAN_LIVE(span_ptr)) == 0)
+                free_block(span_ptr);
+            span_ptr = NULL;
+        }
+    }
 
-            return newptr;
+    if (span_ptr == NULL) { // Take a new span
+        span_ptr = malloc_cacheline_block(SPAN_SIZE);
+        if (span_ptr == NULL) // Failed to allocate span
+            return NULL;
+
+        PUT(SPAN_LIVE(span_ptr), 0); // No object in use
+        PUT(SPAN_RETIRED(span_ptr), 0); // Owned by calling thread
+        for (i = 0; i < SPAN_CLASSES; i++)
+            PUT_PTR(SPAN_FREE_ROOT(span_ptr, i), NULL); // No freed object
+
+        span_cursor = (char*)span_ptr + CACHELINE + WORDSIZE; // Objects start after metadata line, double word aligned
+        span_generation = heap_generation;
+        pthread_setspecific(span_key, span_ptr); // Retire it if thread exits while it is current
+    }
+
+    // Carve object
+    block_ptr = (char*)span_cursor + WORDSIZE;
+    PUT(span_cursor, ((char*)span_cursor - (char*)span_ptr) << 16 | object_size | SPAN_BIT | ALLOCATED); // Header of object
+    span_cursor = (char*)span_cursor + object_size;
+    PUT(SPAN_LIVE(span_ptr), GET(SPAN_LIVE(span_ptr)) + 1);
+
+    return block_ptr;
+}
+
+static void span_free(void* ptr) {
+    /*
+    The function that returns object to the span it was carved from.
+    Only the owner of the span reuses it. A retired span is freed with its last object.
+
+    Args:
+        void* ptr: Pointer of object to free
+
+    Returns:
+        void: None
+    */
+
+    void* span = SPAN_OF(ptr); // Span holding object
+    int span_class = SPAN_OBJECT_SIZE(ptr) / SPAN_GRANULE - 1;
+
+    PUT(NEXT_PTR(ptr), GET(SPAN_FREE_ROOT(span, span_class))); // Push to free list of span
+    PUT_PTR(SPAN_FREE_ROOT(span, span_class), ptr);
+    PUT(SPAN_LIVE(span), GET(SPAN_LIVE(span)) - 1);
+
+    if (GET(SPAN_LIVE(span)) == 0 && GET(SPAN_RETIRED(span))) // Owner moved on and span is empty
+        free_block(span);
+
+    return;
+}
+
+static void* span_realloc(void* ptr, size_t size) {
+    /*
+    The function that reallocates span object, in place if it still fits.
+
+    Args:
+        void* ptr: Pointer of object to realloc
+        size_t size: Size of payload
+
+    Returns:
+        void* newptr: Pointer of new block
+    */
+
+    size_t old_size = SPAN_OBJECT_SIZE(ptr) - WORDSIZE; // Payload of object
+    void* newptr;
+
+    if (size == 0) { // free object if size is 0
+        span_free(ptr);
+        return NULL;
+    }
+
+    if (size <= old_size) // Object still fits
+        return ptr;
+
+    newptr = size <= SPAN_OBJECT_MAX ? span_malloc(size) : malloc_block(size);
+    if (newptr == NULL) // Failed to allocate
+        return NULL;
+
+    TRACE_COPY(newptr, ptr, old_size);
+    memcpy(newptr, ptr, old_size); // Move payload to new block
+    span_free(ptr);
+
+    return newptr;
+}
+
+static void* span_adopt(void* ptr, size_t size) {
+    /*
+    The function that moves block of shared free lists into span of calling thread, when threaded realloc
+    shrinks it to a span object size. Keeping it in place would leave a small block that shares its cache
+    line with blocks of other threads.
+
+    Args:
+        void* ptr: Pointer of block (not span object) to realloc
+        size_t size: Size of payload, from 1 to SPAN_OBJECT_MAX
+
+    Returns:
+        void* newptr: Pointer of span object
+    */
+
+    size_t old_size = GET_SIZE(HEADER_PTR(ptr)) - DWORDSIZE; // Payload of block
+    void* newptr = span_malloc(size);
+
+    if (newptr == NULL) // Failed to allocate
+        return NULL;
+
+    if (old_size > size)
+        old_size = size;
+    TRACE_COPY(newptr, ptr, old_size);
+    memcpy(newptr, ptr, old_size); // Move payload to span object
+    free_block(ptr);
+    stats.realloc_copies++;
+
+    return newptr;
+}
+
+static void span_thread_exit(void* span) {
+    /*
+    The function that retires the span of an exiting thread, as the destructor of span_key.
+    Only the owner retires its span, so without it a span left by a thread would never be freed.
+
+    Args:
+        void* span: Span of exiting thread when it was taken
+
+    Returns:
+        void: None
+    */
+
+    LOCK();
+    if (span == span_ptr && span_generation == heap_generation) { // Still current and on this heap
+        PUT(SPAN_RETIRED(span), 1); // Span is freed with its last object
+        if (GET(SPAN_LIVE(span)) == 0)
+            free_block(span);
+    }
+    span_ptr = NULL;
+    UNLOCK();
+}
+
+static void make_span_key(void) {
+    /*
+    The function that creates span_key once, when threaded mode is first enabled.
+
+    Returns:
+        void: None
+    */
+
+    pthread_key_create(&span_key, span_thread_exit);
+}
+
+/* 
+ * mm_malloc - Allocate a block from the segregated free lists. In threaded
+ *     mode, small blocks are carved from a span of the calling thread.
+ */
+void *mm_malloc(size_t size)
+{
+    /*
+    The function that allocates block.
+    Always allocate a block whose size is a multiple of the alignment.
+
+    Args:
+        size_t size: Size of block to allocate
+    
+    Returns:
+        void* block_ptr: Pointer of allocated block
+    
+    */
+
+    void* block_ptr;
+
+    LOCK();
+    if (threaded && size <= SPAN_OBJECT_MAX)
+        block_ptr = span_malloc(size);
+    else
+        block_ptr = malloc_block(size);
+    UNLOCK();
+
+    return block_ptr;
+}
+
+/*
+ * mm_free - Free a block, coalescing it with free neighbors.
+ */
+void mm_free(void *ptr)
+{
+    /*
+    The function that frees block.
+
+    Args:
+        void* ptr: Pointer of block to free
+    
+    Returns:
+        void: None
+    
+    */
+
+    if (ptr == NULL) // Nothing to free
+        return;
+
+    LOCK();
+    if (IS_SPAN_OBJECT(ptr))
+        span_free(ptr);
+    else
+        free_block(ptr);
+    UNLOCK();
+
+    return;
+}
+
+/*
+ * mm_realloc - Grow a block in place if its neighbor allows, else move it.
+ */
+void *mm_realloc(void *ptr, size_t size)
+{
+    /*
+    The function that reallocates block to larger size if possible.
+    And allocates new block if not possible.
+
+    Args: 
+        void* ptr: Pointer of block to realloc
+        size_t size: Size of block to realloc
+    
+    Returns:
+        void* newptr: Pointer of new block
+    
+    */
+
+    void* newptr;
+
+    LOCK();
+    if (ptr == NULL && threaded && size <= SPAN_OBJECT_MAX)
+        newptr = span_malloc(size);
+    else if (ptr != NULL && IS_SPAN_OBJECT(ptr))
+        newptr = span_realloc(ptr, size);
+    else if (ptr != NULL && threaded && size != 0 && size <= SPAN_OBJECT_MAX)
+        newptr = span_adopt(ptr, size);
+    else
+        newptr = realloc_block(ptr, size);
+    UNLOCK();
+
+    return newptr;
+}
+
+/*
+ * mm_malloc_cacheline - Allocate a block that is alone on its cache lines.
+ */
+void *mm_malloc_cacheline(size_t size)
+{
+    /*
+    The function that allocates block whose payload starts a cache line and shares none of its cache lines
+    with another block's payload. Block can be freed with mm_free.
+
+    Args:
+        size_t size: Size of block to allocate
+
+    Returns:
+        void* block_ptr: Pointer of allocated block, aligned to CACHELINE
+    */
+
+    void* block_ptr;
+
+    LOCK();
+    block_ptr = malloc_cacheline_block(size);
+    UNLOCK();
+
+    return block_ptr;
+}
+
+/*
+ * mm_calloc - Allocate a zeroed array of nmemb elements of size bytes.
+ */
+void *mm_calloc(size_t nmemb, size_t size)
+{
+    /*
+    The function that allocates block like mm_malloc and clears its payload.
+
+    Args:
+        size_t nmemb: Number of elements
+        size_t size: Size of element
+
+    Returns:
+        void* block_ptr: Pointer of allocated block, NULL if failed or nmemb * size overflows
+    */
+
+    void* block_ptr;
+
+    if (size != 0 && nmemb > (size_t)-1 / size) // Size of array overflows
+        return NULL;
+
+    block_ptr = mm_malloc(nmemb * size);
+    if (block_ptr != NULL) {
+        TRACE_FILL(block_ptr, nmemb * size);
+        memset(block_ptr, 0, nmemb * size); // Heap is reused, so payload is not known to be zero
+    }
+
+    return block_ptr;
+}
+
+/*
+ * mm_memalign - Allocate a block whose payload is aligned to a power of two.
+ */
+void *mm_memalign(size_t alignment, size_t size)
+{
+    /*
+    The function that allocates block aligned to alignment. Alignments up to DWORDSIZE are those
+    of every block, larger ones trim a larger block like mm_malloc_cacheline. Block can be freed
+    with mm_free.
+
+    Args:
+        size_t alignment: Alignment of payload, a power of two
+        size_t size: Size of payload
+
+    Returns:
+        void* block_ptr: Pointer of allocated block, NULL if failed or alignment is not a power of two
+    */
+
+    void* block_ptr;
+    size_t block_size = ALIGN(size) + 2 * WORDSIZE; // Add header, footer space
+
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) // Not a power of two
+        return NULL;
+
+    if (alignment <= DWORDSIZE)
+        return mm_malloc(size);
+
+    if (size == 0) // Nothing to allocate
+        return NULL;
+
+    LOCK();
+    block_ptr = malloc_aligned_block(block_size > 2 * DWORDSIZE ? block_size : 2 * DWORDSIZE, alignment);
+    UNLOCK();
+
+    return block_ptr;
+}
+
+/*
+ * mm_free_sized - Free a block whose payload size the caller knows.
+ */
+void mm_free_sized(void *ptr, size_t size)
+{
+    /*
+    The function that frees block like mm_free. Every block keeps its size in its header, which
+    coalescing reads anyway, so the size is not needed.
+
+    Args:
+        void* ptr: Pointer of block to free
+        size_t size: Size the block was allocated with
+
+    Returns:
+        void: None
+    */
+
+    if (ptr == NULL) // Nothing to free
+        return;
+
+    mm_free(ptr);
+
+    return;
+}
+
+/*
+ * mm_malloc_batch - Allocate n blocks of the same size at once.
+ */
+int mm_malloc_batch(size_t size, int n, void **ptrs)
+{
+    /*
+    The function that allocates n blocks like mm_malloc, taking the heap lock once in threaded mode.
+
+    Args:
+        size_t size: Size of payload of each block
+        int n: Number of blocks
+        void** ptrs: Where to store the pointers of the blocks
+
+    Returns:
+        int: Number of blocks allocated, fewer than n if heap ran out
+    */
+
+    int i;
+
+    LOCK();
+    for (i = 0; i < n; i++) {
+        if (threaded && size <= SPAN_OBJECT_MAX)
+            ptrs[i] = span_malloc(size);
+        else
+            ptrs[i] = malloc_block(size);
+        if (ptrs[i] == NULL) // Failed to allocate
+            break;
+    }
+    UNLOCK();
+
+    return i;
+}
+
+/*
+ * mm_free_batch - Free n blocks at once.
+ */
+void mm_free_batch(void **ptrs, int n)
+{
+    /*
+    The function that frees n blocks like mm_free, taking the heap lock once in threaded mode.
+
+    Args:
+        void** ptrs: Pointers of blocks to free
+        int n: Number of blocks
+
+    Returns:
+        void: None
+    */
+
+    int i;
+
+    LOCK();
+    for (i = 0; i < n; i++) {
+        if (ptrs[i] == NULL) // Nothing to free
+            continue;
+        if (IS_SPAN_OBJECT(ptrs[i]))
+            span_free(ptrs[i]);
+        else
+            free_block(ptrs[i]);
+    }
+    UNLOCK();
+
+    return;
+}
+
+/*
+ * mm_usable_size - Report how many bytes of a block's payload may be used.
+ */
+size_t mm_usable_size(void *ptr)
+{
+    /*
+    The function that returns the payload size of an allocated block, which is at least the size
+    it was requested with. Span objects have only a header, other blocks a header and a footer.
+
+    Args:
+        void* ptr: Pointer of allocated block, or NULL
+
+    Returns:
+        size_t: Usable bytes of block, 0 for NULL
+    */
+
+    if (ptr == NULL)
+        return 0;
+    if (IS_SPAN_OBJECT(ptr))
+        return SPAN_OBJECT_SIZE(ptr) - WORDSIZE;
+
+    return GET_SIZE(HEADER_PTR(ptr)) - DWORDSIZE;
+}
+
+/*
+ * mm_set_threaded - Enable locking and per-thread spans.
+ */
+void mm_set_threaded(int enable)
+{
+    /*
+    The function that switches threaded mode. In threaded mode every call takes the heap lock,
+    and blocks of at most SPAN_OBJECT_MAX bytes (also when realloc shrinks a block to that size) come from
+    per-thread spans, so no two threads share a cache line through them. Larger blocks come from the shared
+    free lists and may share a line with blocks of other threads.
+    Must not be called while other threads are using the heap. mm_init is never locked.
+
+    Args:
+        int enable: 1 to enable threaded mode, 0 to disable
+
+    Returns:
+        void: None
+    */
+
+    if (enable)
+        pthread_once(&span_key_once, make_span_key);
+    threaded = enable;
+
+    return;
+}
+
+/*
+ * mm_get_stats - Report event counts since the last mm_init, and the free lists now.
+ */
+void mm_get_stats(mm_stats_t *stats_ptr)
+{
+    /*
+    The function that copies event counts (extend_heap calls, moving and in-place reallocs)
+    and the bytes and blocks on the free lists.
+
+    Args:
+        mm_stats_t* stats_ptr: Where to copy the counts
+
+    Returns:
+        void: None
+    */
+
+    LOCK();
+    *stats_ptr = stats;
+    UNLOCK();
+
+    return;
+}
+
+/*
+ * mm_dump_layout - Write a snapshot of the heap blocks to a file (see layout.h).
+ */
+int mm_dump_layout(FILE *fp)
+{
+    /*
+    The function that walks every block from heap_root to the epilogue and writes
+    a layouthdr_t and one layoutrun_t per run of adjacent blocks of equal size, state
+    and size class. Runs are collected LAYOUT_BUFFER at a time, so the heap is walked
+    once and written in few large writes. A span (threaded mode) is one allocated block.
+
+    Args:
+        FILE* fp: Where to write the snapshot
+
+    Returns:
+        int: Number of runs written, -1 if writing failed
+    */
+
+    layouthdr_t header;
+    layoutrun_t runs[LAYOUT_BUFFER];
+    layoutrun_t* run = NULL; // Run that current block may extend
+    int num_buffered = 0;
+    int num_runs = 0;
+    size_t size;
+    unsigned short flags;
+    void* block_ptr;
+
+    LOCK();
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LAYOUT_MAGIC, sizeof(header.magic));
+    header.version = LAYOUT_VERSION;
+    header.run_size = sizeof(layoutrun_t);
+    header.heap_lo = (size_t)mem_heap_lo();
+    header.heap_size = mem_heapsize();
+    header.num_classes = NUM_SIZE_CLASSES;
+    if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+        UNLOCK();
+        return -1;
+    }
+
+    for (block_ptr = NEXT_BLOCK_PTR(heap_root); GET_SIZE(HEADER_PTR(block_ptr)) != 0; block_ptr = NEXT_BLOCK_PTR(block_ptr)) {
+        size = GET_SIZE(HEADER_PTR(block_ptr));
+        flags = (GET_IS_ALLOCATED(HEADER_PTR(block_ptr)) ? LAYOUT_ALLOCATED : 0) | (GET(HEADER_PTR(block_ptr)) & GROW_BIT ? LAYOUT_GROWN : 0);
+
+        if (run != NULL && run->size == size && run->flags == flags) { // Same as previous block
+            run->count++;
+            continue;
+        }
+
+        if (num_buffered == LAYOUT_BUFFER) { // Buffer is full
+            if (fwrite(runs, sizeof(layoutrun_t), num_buffered, fp) != num_buffered) {
+                UNLOCK();
+                return -1;
+            }
+            num_buffered = 0;
         }
+
+        // Start new run
+        run = &runs[num_buffered++];
+        memset(run, 0, sizeof(*run));
+        run->offset = (char*)HEADER_PTR(block_ptr) - (char*)mem_heap_lo();
+        run->size = size;
+        run->count = 1;
+        run->flags = flags;
+        run->size_class = SIZE_CLASS(size);
+        num_runs++;
     }
 
-    return ptr;
+    if (fwrite(runs, sizeof(layoutrun_t), num_buffered, fp) != num_buffered) {
+        UNLOCK();
+        return -1;
+    }
+    UNLOCK();
+
+    return num_runs;
 }
@@ -4,6 +4,27 @@ extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
+extern void *mm_malloc_cacheline(size_t size);
+extern void *mm_calloc(size_t nmemb, size_t size);
+extern void *mm_memalign(size_t alignment, size_t size);
+extern void mm_free_sized(void *ptr, size_t size);
+extern int mm_malloc_batch(size_t size, int n, void **ptrs);
+extern void mm_free_batch(void **ptrs, int n);
+extern void mm_set_threaded(int enable);
+extern size_t mm_usable_size(void *ptr);
+extern int mm_dump_layout(FILE *fp);  /* heap snapshot, see layout.h */
+
+/* Event counts of mm.c since the last mm_init (mdriver -V), and the
+ * current state of its free lists (mdriver -U) */
+typedef struct {
+    unsigned long extend_heaps;    /* successful extend_heap calls */
+    unsigned long realloc_copies;  /* reallocs that moved the payload */
+    unsigned long realloc_inplace; /* reallocs that grew in place */
+    unsigned long free_bytes;      /* bytes of the blocks on the free lists */
+    unsigned long free_blocks;     /* blocks on the free lists */
+} mm_stats_t;
+
+extern void mm_get_stats(mm_stats_t *stats);
 
 
 /* 
@@ -0,0 +1,67 @@
+/*
+ * mm_variants.c - Table of the policy variants of mm.c linked into mdriver
+ *
+ * Each variant is mm.c compiled with a different FIT_POLICY and
+ * INSERT_POLICY (see the Makefile). The plain mm.o build keeps the
+ * default policies and the unprefixed mm_* names. mm_traced_variants[]
+ * are the same builds with MM_ADDR_TRACE defined, for mdriver -L, -S.
+ */
+#include <stdio.h>
+#include "mm.h"
+#include "memlib.h"
+#include "allocator.h"
+
+#define DECLARE_VARIANT(prefix) \
+    extern int prefix##_init(void); \
+    extern void *prefix##_malloc(size_t size); \
+    extern void prefix##_free(void *ptr); \
+    extern void *prefix##_realloc(void *ptr, size_t size); \
+    extern size_t prefix##_usable_size(void *ptr); \
+    extern void prefix##_get_stats(mm_stats_t *stats); \
+    extern void prefix##_set_threaded(int enable); \
+    extern int prefix##_dump_layout(FILE *fp); \
+    extern void *prefix##_calloc(size_t nmemb, size_t size); \
+    extern void *prefix##_memalign(size_t alignment, size_t size); \
+    extern void prefix##_free_sized(void *ptr, size_t size); \
+    extern int prefix##_malloc_batch(size_t size, int n, void **ptrs); \
+    extern void prefix##_free_batch(void **ptrs, int n)
+
+#define VARIANT(name, prefix) \
+    {name, ALLOC_HEAP, prefix##_init, prefix##_malloc, prefix##_free, \
+     prefix##_realloc, prefix##_usable_size, mem_reset_brk, \
+     prefix##_get_stats, prefix##_set_threaded, prefix##_dump_layout, \
+     prefix##_calloc, prefix##_memalign, prefix##_free_sized, \
+     prefix##_malloc_batch, prefix##_free_batch}
+
+DECLARE_VARIANT(mm_next_lifo);
+DECLARE_VARIANT(mm_best_lifo);
+DECLARE_VARIANT(mm_first_addr);
+DECLARE_VARIANT(mm_next_addr);
+DECLARE_VARIANT(mm_best_addr);
+DECLARE_VARIANT(mm_trace);
+DECLARE_VARIANT(mm_trace_next_lifo);
+DECLARE_VARIANT(mm_trace_best_lifo);
+DECLARE_VARIANT(mm_trace_first_addr);
+DECLARE_VARIANT(mm_trace_next_addr);
+DECLARE_VARIANT(mm_trace_best_addr);
+
+allocator_t mm_variants[] = {
+    VARIANT("first-lifo", mm),  /* default build of mm.c */
+    VARIANT("next-lifo", mm_next_lifo),
+    VARIANT("best-lifo", mm_best_lifo),
+    VARIANT("first-addr", mm_first_addr),
+    VARIANT("next-addr", mm_next_addr),
+    VARIANT("best-addr", mm_best_addr),
+    {NULL}
+};
+
+/* In the order of mm_variants[] */
+allocator_t mm_traced_variants[] = {
+    VARIANT("first-lifo", mm_trace),
+    VARIANT("next-lifo", mm_trace_next_lifo),
+    VARIANT("best-lifo", mm_trace_best_lifo),
+    VARIANT("first-addr", mm_trace_first_addr),
+    VARIANT("next-addr", mm_trace_next_addr),
+    VARIANT("best-addr", mm_trace_best_addr),
+    {NULL}
+};
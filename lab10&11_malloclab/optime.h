@@ -0,0 +1,39 @@
+#ifndef __OPTIME_H_
+#define __OPTIME_H_
+
+/*
+ * optime.h - The per-op timing dumps written by mdriver -O
+ *
+ * A dump is an optimehdr_t followed by one optime_t per op of the
+ * trace, in trace order: the fewest timer ticks (cycles on x86) that
+ * the op's allocator call took over the dump's runs, less the cost of
+ * reading the timer. Taking the fewest of a fixed number of replays
+ * keeps interrupts and cold misses out of the times, so two dumps of
+ * the same trace differ where the allocator does, and optimediff can
+ * point at the ops that got slower. Dumps are in host byte order; the
+ * header's version and rec_size fields reject files written with a
+ * different layout.
+ */
+
+#define OPTIME_MAGIC "MMOPTIME"  /* first 8 bytes of a dump */
+#define OPTIME_VERSION 1
+
+/* Header of a dump; the optime_t records follow it */
+typedef struct {
+    char magic[8];               /* OPTIME_MAGIC, not NUL terminated */
+    unsigned int version;        /* OPTIME_VERSION */
+    unsigned int rec_size;       /* sizeof(optime_t) */
+    unsigned long long seed;     /* mdriver -z seed of the run */
+    unsigned int num_ops;        /* records that follow */
+    unsigned int runs;           /* replays the times are the fewest of */
+    char unit[8];                /* "cycles" or "ns", NUL terminated */
+} optimehdr_t;
+
+/* One op of the trace */
+typedef struct {
+    unsigned int ticks;          /* fewest ticks of its call */
+    unsigned short type;         /* ALLOC, FREE, ... (see trace.h) */
+    unsigned short pad;
+} optime_t;
+
+#endif /* __OPTIME_H_ */
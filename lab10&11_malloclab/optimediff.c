@@ -0,0 +1,238 @@
+/*
+ * optimediff.c - Find the ops of a trace that got slower between two
+ *     per-op timing dumps written by mdriver -O
+ *
+ * Both dumps must be of the same trace. The ops are cut into windows of
+ * equal length; a window is slower if its ticks grew by more than the
+ * threshold, and runs of adjacent slower windows are merged into
+ * ranges. The ranges that added the most ticks are listed first, with
+ * the share of the total slowdown they explain and the call that added
+ * the most in them, so that a regression can be traced to the region
+ * of the trace (and the mm.c path) responsible without bisecting by
+ * hand. Totals per call type are printed first.
+ *
+ * Usage: optimediff [-h] [-w <ops>] [-n <ranges>] [-t <pct>] <before> <after>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "trace.h"
+#include "optime.h"
+
+/* A run of slower windows */
+typedef struct {
+    unsigned int lo, hi;            /* ops [lo, hi) */
+    double before, after;           /* their ticks in each dump */
+    double added[NUM_OP_TYPES];     /* ticks added by each call type */
+} range_t;
+
+static char *names[NUM_OP_TYPES] = {"malloc", "free", "realloc", "calloc",
+                                    "memalign", "free_sized", "malloc_batch",
+                                    "free_batch"};
+
+static void usage(void);
+
+/*
+ * read_dump - Read the header and every op of the dump at path. Quits
+ *     if the file is not a whole dump of this layout.
+ */
+static optime_t *read_dump(char *path, optimehdr_t *hdr)
+{
+    FILE *fp;
+    optime_t *recs;
+
+    if ((fp = fopen(path, "rb")) == NULL) {
+        perror(path);
+        exit(1);
+    }
+    if (fread(hdr, sizeof(*hdr), 1, fp) != 1 ||
+        memcmp(hdr->magic, OPTIME_MAGIC, sizeof(hdr->magic)) != 0) {
+        fprintf(stderr, "%s: not a per-op timing dump\n", path);
+        exit(1);
+    }
+    if (hdr->version != OPTIME_VERSION || hdr->rec_size != sizeof(optime_t)) {
+        fprintf(stderr, "%s: dump version %u, record size %u; expected %u, %u\n",
+                path, hdr->version, hdr->rec_size, OPTIME_VERSION,
+                (unsigned)sizeof(optime_t));
+        exit(1);
+    }
+    if ((recs = malloc((hdr->num_ops + 1) * sizeof(optime_t))) == NULL) {
+        fprintf(stderr, "malloc failed in read_dump\n");
+        exit(1);
+    }
+    if (fread(recs, sizeof(optime_t), hdr->num_ops, fp) != hdr->num_ops) {
+        fprintf(stderr, "%s: truncated dump of %u ops\n", path, hdr->num_ops);
+        exit(1);
+    }
+    fclose(fp);
+    return recs;
+}
+
+/*
+ * cmp_added - qsort comparison of ranges, most ticks added first
+ */
+static int cmp_added(const void *a, const void *b)
+{
+    double x = ((const range_t *)a)->after - ((const range_t *)a)->before;
+    double y = ((const range_t *)b)->after - ((const range_t *)b)->before;
+
+    return (x < y) - (x > y);
+}
+
+/*
+ * print_types - Print the ops and the ticks of each call type in both
+ *     dumps
+ */
+static void print_types(optime_t *before, optime_t *after, unsigned num_ops,
+                        char *unit)
+{
+    double tb[NUM_OP_TYPES] = {0}, ta[NUM_OP_TYPES] = {0};
+    double sum_b = 0, sum_a = 0;
+    unsigned long count[NUM_OP_TYPES] = {0};
+    unsigned i;
+    int t;
+
+    for (i = 0; i < num_ops; i++) {
+        t = before[i].type;
+        count[t]++;
+        tb[t] += before[i].ticks;
+        ta[t] += after[i].ticks;
+    }
+    printf("%-12s %10s %14s %14s %8s   (%s)\n", "call", "ops", "before",
+           "after", "change", unit);
+    for (t = 0; t < NUM_OP_TYPES; t++) {
+        if (count[t] == 0)
+            continue;
+        printf("%-12s %10lu %14.0f %14.0f %+7.1f%%\n", names[t], count[t],
+               tb[t], ta[t], tb[t] ? 100.0 * (ta[t] - tb[t]) / tb[t] : 0);
+        sum_b += tb[t];
+        sum_a += ta[t];
+    }
+    printf("%-12s %10u %14.0f %14.0f %+7.1f%%\n", "total", num_ops, sum_b,
+           sum_a, sum_b ? 100.0 * (sum_a - sum_b) / sum_b : 0);
+}
+
+int main(int argc, char **argv)
+{
+    int c, t, worst, top = 10;
+    unsigned window = 0, i, lo, hi, num_ops, num_ranges = 0;
+    double threshold = 10, wb, wa, slowdown = 0;
+    optimehdr_t hdr_b, hdr_a;
+    optime_t *before, *after;
+    range_t *ranges, *r;
+
+    while ((c = getopt(argc, argv, "w:n:t:h")) != EOF) {
+        switch (c) {
+        case 'w':
+            window = atoi(optarg);
+            break;
+        case 'n':
+            top = atoi(optarg);
+            break;
+        case 't':
+            threshold = atof(optarg);
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind != argc - 2 || top < 1 || threshold < 0) {
+        usage();
+        exit(1);
+    }
+    before = read_dump(argv[optind], &hdr_b);
+    after = read_dump(argv[optind + 1], &hdr_a);
+    num_ops = hdr_b.num_ops;
+    if (hdr_a.num_ops != num_ops || strcmp(hdr_a.unit, hdr_b.unit) != 0) {
+        fprintf(stderr, "The dumps are of different traces or timers\n");
+        exit(1);
+    }
+    for (i = 0; i < num_ops; i++)
+        if (before[i].type != after[i].type || before[i].type >= NUM_OP_TYPES) {
+            fprintf(stderr, "The dumps are of different traces (op %u)\n", i);
+            exit(1);
+        }
+    if (hdr_a.seed != hdr_b.seed)
+        printf("warning: the dumps were made with seeds %llu and %llu\n",
+               hdr_b.seed, hdr_a.seed);
+    if (window == 0)
+        window = (num_ops >= 100) ? num_ops / 100 : 1;
+
+    printf("%u ops, fewest of %u and %u runs per op\n\n", num_ops,
+           hdr_b.runs, hdr_a.runs);
+    print_types(before, after, num_ops, hdr_b.unit);
+
+    /* Merge adjacent slower windows into ranges */
+    if ((ranges = calloc(num_ops / window + 1, sizeof(range_t))) == NULL) {
+        fprintf(stderr, "calloc failed\n");
+        exit(1);
+    }
+    r = NULL;
+    for (lo = 0; lo < num_ops; lo = hi) {
+        hi = (num_ops - lo > window) ? lo + window : num_ops;
+        wb = wa = 0;
+        for (i = lo; i < hi; i++) {
+            wb += before[i].ticks;
+            wa += after[i].ticks;
+        }
+        slowdown += wa - wb;
+        if (wa <= wb * (1 + threshold / 100)) {
+            r = NULL;
+            continue;
+        }
+        if (r == NULL) {
+            r = &ranges[num_ranges++];
+            r->lo = lo;
+        }
+        r->hi = hi;
+        r->before += wb;
+        r->after += wa;
+        for (i = lo; i < hi; i++)
+            r->added[before[i].type] += (double)after[i].ticks - before[i].ticks;
+    }
+    qsort(ranges, num_ranges, sizeof(range_t), cmp_added);
+
+    printf("\n%u slower ranges of %u-op windows (more than %g%% slower)",
+           num_ranges, window, threshold);
+    if (num_ranges == 0) {
+        printf("\n");
+        return 0;
+    }
+    printf(", slowest first:\n");
+    printf("%10s %10s %12s %12s %8s %7s  %s\n", "first op", "last op",
+           "before", "after", "change", "share", "most added by");
+    for (i = 0; i < num_ranges && i < (unsigned)top; i++) {
+        r = &ranges[i];
+        for (worst = 0, t = 1; t < NUM_OP_TYPES; t++)
+            if (r->added[t] > r->added[worst])
+                worst = t;
+        printf("%10u %10u %12.0f %12.0f %+7.1f%% %6.1f%%  %s\n", r->lo,
+               r->hi - 1, r->before, r->after,
+               r->before ? 100.0 * (r->after - r->before) / r->before : 0,
+               (slowdown > 0) ? 100.0 * (r->after - r->before) / slowdown : 0,
+               names[worst]);
+    }
+    free(ranges);
+    free(before);
+    free(after);
+    return 0;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: optimediff [-h] [-w <ops>] [-n <ranges>] [-t <pct>] <before> <after>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h          Print this message.\n");
+    fprintf(stderr, "\t-n <ranges> List the <ranges> slowest ranges (default 10).\n");
+    fprintf(stderr, "\t-t <pct>    Count windows more than <pct>%% slower (default 10).\n");
+    fprintf(stderr, "\t-w <ops>    Ops per window (default 1/100 of the trace).\n");
+}
@@ -0,0 +1,102 @@
+/*
+ * perfctr.c - Hardware performance counters via perf_event_open
+ *
+ * perfctr_init opens one counter per event, each on its own rather
+ * than as a group, so that the events the CPU cannot count at once are
+ * multiplexed instead of failing together. perfctr_stop scales each
+ * count by the fraction of the time its counter was actually running.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perfctr.h"
+
+char *perfctr_names[PERFCTR_EVENTS] = {
+    "instr", "cycles", "L1d-miss", "LLC-miss", "dTLB-miss", "br-miss"
+};
+
+/* Encoding of a hardware cache event for perf_event_attr.config */
+#define CACHE_EVENT(cache, op, result) \
+    ((cache) | ((op) << 8) | ((result) << 16))
+
+static struct {
+    unsigned int type;
+    unsigned long long config;
+} events[PERFCTR_EVENTS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D, 
+				     PERF_COUNT_HW_CACHE_OP_READ,
+				     PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB, 
+				     PERF_COUNT_HW_CACHE_OP_READ,
+				     PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+static int fds[PERFCTR_EVENTS] = {-1, -1, -1, -1, -1, -1};
+
+/*
+ * perfctr_init - Open the counters of the calling thread. Returns the
+ *     number of events that can be counted (0 if none).
+ */
+int perfctr_init(void)
+{
+    struct perf_event_attr attr;
+    int i, n = 0;
+
+    for (i = 0; i < PERFCTR_EVENTS; i++) {
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = events[i].type;
+	attr.config = events[i].config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;  /* allowed at perf_event_paranoid 2 */
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | 
+	    PERF_FORMAT_TOTAL_TIME_RUNNING;
+	fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+	if (fds[i] >= 0)
+	    n++;
+    }
+    return n;
+}
+
+/*
+ * perfctr_start - Zero the counters and start counting
+ */
+void perfctr_start(void)
+{
+    int i;
+
+    for (i = 0; i < PERFCTR_EVENTS; i++)
+	if (fds[i] >= 0) {
+	    ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+	    ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+/*
+ * perfctr_stop - Stop counting and store the counts since 
+ *     perfctr_start in *counts
+ */
+void perfctr_stop(perfctr_t *counts)
+{
+    unsigned long long v[3];  /* value, time enabled, time running */
+    int i;
+
+    for (i = 0; i < PERFCTR_EVENTS; i++)
+	if (fds[i] >= 0)
+	    ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    for (i = 0; i < PERFCTR_EVENTS; i++) {
+	counts->counts[i] = -1;
+	if (fds[i] < 0 || read(fds[i], v, sizeof(v)) != sizeof(v) || v[2] == 0)
+	    continue;
+	counts->counts[i] = (double)v[0] * v[1] / v[2];
+    }
+}
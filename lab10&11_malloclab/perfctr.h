@@ -0,0 +1,33 @@
+/*
+ * perfctr.h - Hardware performance counters via perf_event_open
+ *
+ * Counts user-mode events of the calling thread while a function
+ * runs. Counters the kernel or the CPU does not provide (e.g. when
+ * perf_event_paranoid forbids them, or in a VM without a virtual PMU)
+ * read as -1, and the rest still work.
+ */
+#ifndef __PERFCTR_H_
+#define __PERFCTR_H_
+
+/* The counted events, in the order of perfctr_t.counts */
+enum {
+    PERFCTR_INSTRUCTIONS,
+    PERFCTR_CYCLES,
+    PERFCTR_L1D_MISSES,   /* L1 data cache read misses */
+    PERFCTR_LLC_MISSES,   /* last level cache misses */
+    PERFCTR_DTLB_MISSES,  /* data TLB read misses */
+    PERFCTR_BRANCH_MISSES,
+    PERFCTR_EVENTS
+};
+
+typedef struct {
+    double counts[PERFCTR_EVENTS];  /* -1 if the event is not counted */
+} perfctr_t;
+
+extern char *perfctr_names[PERFCTR_EVENTS];
+
+int perfctr_init(void);
+void perfctr_start(void);
+void perfctr_stop(perfctr_t *counts);
+
+#endif /* __PERFCTR_H_ */
@@ -0,0 +1,408 @@
+/*
+ * rec2trace.c - Convert a librecorder.so log to a mdriver trace
+ *
+ * Sorts the records of the log (see recorder.h) into call order and
+ * replays them against a table of live addresses, giving each block a
+ * dense id from 0 in order of allocation. A realloc keeps the id of the
+ * block it resizes. callocs and aligned allocations become c and m
+ * requests. Calls that can't be replayed are dropped and counted:
+ * frees of blocks allocated before recording started, failed
+ * allocations, and callocs too large for a trace. If an address is returned again while still live (a free
+ * lost when the program exited with threads running), the old block is
+ * freed first. libc returns a block for malloc(0), which mm_malloc
+ * does not, so zero-byte requests become one-byte requests. The
+ * suggested heap size is the peak of the live bytes.
+ *
+ * The trace is written as a .rep, or in the binary format of trace.h
+ * with -b or when the output name ends in .bin. The output defaults to
+ * the log name with .rec replaced by .rep.
+ *
+ * Usage: rec2trace [-b] [-o <file>] <log>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "recorder.h"
+#include "trace.h"
+
+#define MAXLINE 1024
+#define ADDRMAP_MIN 1024      /* initial addrmap slots (a power of 2) */
+
+/* Slot of the table of live addresses */
+typedef struct {
+    unsigned long long addr;  /* block address, 0 if the slot is unused */
+    unsigned int id;          /* trace id of the block */
+    unsigned long long size;  /* its requested size */
+} addrslot_t;
+
+typedef struct {
+    addrslot_t *slots;
+    unsigned long mask;       /* number of slots - 1 */
+    unsigned long count;      /* live addresses */
+} addrmap_t;
+
+static void usage(void);
+
+/* Slot where the search for addr starts */
+#define ADDRMAP_HASH(map, addr) \
+    ((unsigned long)(((addr) >> 4) * 0x9e3779b97f4a7c15ull >> 20) & (map)->mask)
+
+/*
+ * addrmap_alloc - Make map an empty table with n slots
+ */
+static void addrmap_alloc(addrmap_t *map, unsigned long n)
+{
+    if ((map->slots = calloc(n, sizeof(addrslot_t))) == NULL) {
+        fprintf(stderr, "addrmap: calloc failed\n");
+        exit(1);
+    }
+    map->mask = n - 1;
+    map->count = 0;
+}
+
+/*
+ * addrmap_find - Return the slot of addr, or NULL if addr is not live
+ */
+static addrslot_t *addrmap_find(addrmap_t *map, unsigned long long addr)
+{
+    unsigned long i;
+
+    for (i = ADDRMAP_HASH(map, addr); map->slots[i].addr != 0;
+         i = (i + 1) & map->mask)
+        if (map->slots[i].addr == addr)
+            return &map->slots[i];
+    return NULL;
+}
+
+/*
+ * addrmap_insert - Return the slot of addr, adding it if it is not live.
+ *     The table doubles when it becomes half full.
+ */
+static addrslot_t *addrmap_insert(addrmap_t *map, unsigned long long addr)
+{
+    addrslot_t *old;
+    unsigned long i, n;
+
+    if (2 * (map->count + 1) > map->mask + 1) {
+        old = map->slots;
+        n = map->mask + 1;
+        addrmap_alloc(map, 2 * n);
+        for (i = 0; i < n; i++)
+            if (old[i].addr != 0)
+                *addrmap_insert(map, old[i].addr) = old[i];
+        free(old);
+    }
+
+    for (i = ADDRMAP_HASH(map, addr); map->slots[i].addr != 0;
+         i = (i + 1) & map->mask)
+        if (map->slots[i].addr == addr)
+            return &map->slots[i];
+    map->slots[i].addr = addr;
+    map->count++;
+    return &map->slots[i];
+}
+
+/*
+ * addrmap_remove - Remove the address in slot, moving later entries of
+ *     its probe run back so that lookups never stop at the hole early
+ */
+static void addrmap_remove(addrmap_t *map, addrslot_t *slot)
+{
+    unsigned long hole = slot - map->slots;
+    unsigned long i, home;
+
+    for (i = (hole + 1) & map->mask; map->slots[i].addr != 0;
+         i = (i + 1) & map->mask) {
+        home = ADDRMAP_HASH(map, map->slots[i].addr);
+        if (((i - home) & map->mask) >= ((i - hole) & map->mask)) {
+            map->slots[hole] = map->slots[i];
+            hole = i;
+        }
+    }
+    map->slots[hole].addr = 0;
+    map->count--;
+}
+
+/*
+ * cmp_seq - qsort comparison of records by call order
+ */
+static int cmp_seq(const void *a, const void *b)
+{
+    unsigned long long x = ((const rec_t *)a)->seq;
+    unsigned long long y = ((const rec_t *)b)->seq;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * read_log - Read all records of the log at path into *recs
+ */
+static size_t read_log(char *path, rec_t **recs)
+{
+    FILE *fp;
+    rechdr_t hdr;
+    size_t n = 0, cap = 1 << 16;
+
+    if ((fp = fopen(path, "rb")) == NULL) {
+        fprintf(stderr, "Could not open %s\n", path);
+        exit(1);
+    }
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        memcmp(hdr.magic, REC_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.rec_size != sizeof(rec_t)) {
+        fprintf(stderr, "%s is not a recorder log\n", path);
+        exit(1);
+    }
+    if ((*recs = malloc(cap * sizeof(rec_t))) == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        exit(1);
+    }
+    for (;;) {
+        n += fread(*recs + n, sizeof(rec_t), cap - n, fp);
+        if (n < cap)
+            break;
+        cap *= 2;
+        if ((*recs = realloc(*recs, cap * sizeof(rec_t))) == NULL) {
+            fprintf(stderr, "realloc failed\n");
+            exit(1);
+        }
+    }
+    fclose(fp);
+    return n;
+}
+
+/*
+ * emit - Append one trace request to ops
+ */
+static void emit(traceop_t *ops, unsigned *num_ops, int type,
+                 unsigned id, unsigned long long size, unsigned aux)
+{
+    traceop_t *op = &ops[(*num_ops)++];
+
+    op->type = type;
+    op->index = id;
+    op->size = size;
+    op->aux = aux;
+}
+
+int main(int argc, char **argv)
+{
+    int c, binary = 0;
+    char *inpath, *outfile = NULL;
+    char outpath[MAXLINE];
+    FILE *out;
+    rec_t *recs, *r;
+    traceop_t *ops;
+    addrmap_t live, moving;
+    addrslot_t *slot, *moved;
+    tracehdr_t hdr;
+    size_t n, i;
+    unsigned id, num_ops = 0, num_ids = 0, dropped = 0, lost = 0;
+    size_t resized = 0;
+    unsigned long long bytes = 0, peak = 0;
+
+    while ((c = getopt(argc, argv, "bo:h")) != EOF) {
+        switch (c) {
+        case 'b':
+            binary = 1;
+            break;
+        case 'o':
+            outfile = optarg;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+        exit(1);
+    }
+    inpath = argv[optind];
+    if (outfile == NULL) {
+        size_t len = strlen(inpath);
+
+        if (len >= 4 && strcmp(inpath + len - 4, ".rec") == 0)
+            len -= 4;
+        if (len + 5 > MAXLINE) {
+            fprintf(stderr, "Path too long: %s\n", inpath);
+            exit(1);
+        }
+        memcpy(outpath, inpath, len);
+        strcpy(outpath + len, binary ? ".bin" : ".rep");
+        outfile = outpath;
+    } else {
+        size_t len = strlen(outfile);
+
+        if (len >= 4 && strcmp(outfile + len - 4, ".bin") == 0)
+            binary = 1;
+    }
+
+    n = read_log(inpath, &recs);
+    qsort(recs, n, sizeof(rec_t), cmp_seq);
+
+    /* Each record becomes at most two requests */
+    if ((ops = malloc((2 * n + 1) * sizeof(traceop_t))) == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        exit(1);
+    }
+    addrmap_alloc(&live, ADDRMAP_MIN);
+    addrmap_alloc(&moving, ADDRMAP_MIN);
+
+    for (i = 0; i < n; i++) {
+        r = &recs[i];
+        if (r->size > (size_t)-1 || r->aux > 0xffffffffu ||
+            (r->type == REC_CALLOC && r->size != 0 &&
+             r->aux > (size_t)-1 / r->size) ||
+            (r->type == REC_MEMALIGN && (r->aux & (r->aux - 1)) != 0)) {
+            dropped++;
+            continue;
+        }
+        if (r->size == 0 && r->type != REC_FREE && r->ptr != 0)
+            r->size = 1;
+        if (r->aux == 0 && r->type == REC_CALLOC && r->ptr != 0)
+            r->aux = 1;
+        switch (r->type) {
+        case REC_FREE:
+            if ((slot = addrmap_find(&live, r->ptr)) == NULL) {
+                dropped++;
+                break;
+            }
+            emit(ops, &num_ops, FREE, slot->id, 0, 0);
+            bytes -= slot->size;
+            addrmap_remove(&live, slot);
+            break;
+
+        case REC_REALLOC:
+            if (r->old != 0 && (slot = addrmap_find(&live, r->old)) != NULL) {
+                if (r->ptr == 0) {
+                    /* realloc(p, 0) freed p; a failed realloc kept it */
+                    if (r->size == 0) {
+                        emit(ops, &num_ops, FREE, slot->id, 0, 0);
+                        bytes -= slot->size;
+                        addrmap_remove(&live, slot);
+                    } else
+                        dropped++;
+                    break;
+                }
+                id = slot->id;
+                emit(ops, &num_ops, REALLOC, id, r->size, 0);
+                bytes += r->size - (unsigned long long)slot->size;
+                addrmap_remove(&live, slot);
+                /* The new address is live from its REC_REALLOC_DONE */
+                slot = addrmap_insert(&moving, r->ptr);
+                slot->id = id;
+                slot->size = r->size;
+                break;
+            }
+            /* realloc of NULL, or of a block we never saw: an allocation */
+            /* fall through */
+
+        case REC_MALLOC:
+        case REC_CALLOC:
+        case REC_MEMALIGN:
+            if (r->ptr == 0) {
+                dropped++;
+                break;
+            }
+            if (num_ids > TRACE_MAX_INDEX) {
+                fprintf(stderr, "%s: more than %u blocks\n", inpath,
+                        TRACE_MAX_INDEX + 1);
+                exit(1);
+            }
+            if ((slot = addrmap_find(&live, r->ptr)) != NULL) {
+                emit(ops, &num_ops, FREE, slot->id, 0, 0);
+                bytes -= slot->size;
+                addrmap_remove(&live, slot);
+                lost++;
+            }
+            slot = addrmap_insert(&live, r->ptr);
+            slot->id = num_ids++;
+            slot->size = (r->type == REC_CALLOC) ? r->aux * r->size : r->size;
+            emit(ops, &num_ops, (r->type == REC_CALLOC) ? CALLOC :
+                 (r->type == REC_MEMALIGN) ? MEMALIGN : ALLOC,
+                 slot->id, r->size, (r->type == REC_MALLOC) ? 0 : r->aux);
+            bytes += slot->size;
+            break;
+
+        case REC_REALLOC_DONE:
+            resized++;
+            if ((moved = addrmap_find(&moving, r->ptr)) == NULL)
+                break;   /* a realloc that became an allocation */
+            if ((slot = addrmap_find(&live, r->ptr)) != NULL) {
+                emit(ops, &num_ops, FREE, slot->id, 0, 0);
+                bytes -= slot->size;
+                addrmap_remove(&live, slot);
+                lost++;
+            }
+            slot = addrmap_insert(&live, r->ptr);
+            slot->id = moved->id;
+            slot->size = moved->size;
+            addrmap_remove(&moving, moved);
+            break;
+
+        default:
+            fprintf(stderr, "%s: bad record type %u\n", inpath, r->type);
+            exit(1);
+        }
+        if (bytes > peak)
+            peak = bytes;
+    }
+
+    /* Write the trace */
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.sugg_heapsize = (peak > 0x7fffffff) ? 0x7fffffff : (int)peak;
+    hdr.num_ids = num_ids;
+    hdr.num_ops = num_ops;
+    hdr.weight = 1;
+    if ((out = fopen(outfile, binary ? "wb" : "w")) == NULL) {
+        fprintf(stderr, "Could not open %s\n", outfile);
+        exit(1);
+    }
+    if (binary) {
+        memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+        hdr.version = TRACE_VERSION;
+        hdr.op_size = sizeof(traceop_t);
+        fwrite(&hdr, sizeof(hdr), 1, out);
+        fwrite(ops, sizeof(traceop_t), num_ops, out);
+    } else {
+        fprintf(out, "%d\n%d\n%d\n%d\n", hdr.sugg_heapsize, hdr.num_ids,
+                hdr.num_ops, hdr.weight);
+        for (i = 0; i < num_ops; i++) {
+            if (ops[i].type == FREE)
+                fprintf(out, "f %u\n", ops[i].index);
+            else if (ops[i].type == CALLOC || ops[i].type == MEMALIGN)
+                fprintf(out, "%c %u %u %llu\n", TRACE_LETTERS[ops[i].type],
+                        ops[i].index, ops[i].aux, ops[i].size);
+            else
+                fprintf(out, "%c %u %llu\n", TRACE_LETTERS[ops[i].type],
+                        ops[i].index, ops[i].size);
+        }
+    }
+    if (fclose(out) != 0) {
+        fprintf(stderr, "Could not write %s\n", outfile);
+        exit(1);
+    }
+
+    fprintf(stderr, "%s: %u ops, %u ids from %lu calls (%u dropped, %u lost frees)\n",
+            outfile, num_ops, num_ids, (unsigned long)(n - resized), dropped,
+            lost);
+    return 0;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: rec2trace [-hb] [-o <file>] <log>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-b         Write the binary trace format.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-o <file>  Write the trace to <file> (default <log>.rep).\n");
+}
@@ -0,0 +1,445 @@
+/*
+ * recorder.c - Record the malloc/calloc/realloc/free calls of a program
+ *     (and memalign, posix_memalign and aligned_alloc)
+ *
+ * Build as librecorder.so and preload it:
+ *
+ *     unix> LD_PRELOAD=./librecorder.so MMREC_FILE=app.rec ./app
+ *     unix> ./rec2trace -o app.rep app.rec
+ *
+ * Each thread appends rec_t records (see recorder.h) to its own buffer
+ * without locking; a global atomic counter orders the records. Full
+ * buffers go on a queue that a writer thread drains to the log, so the
+ * recorded threads never wait for the disk. Buffers are mmap'd, and
+ * nothing here calls malloc, so the hooks never recurse into themselves
+ * except through libc internals, which a per-thread flag passes through
+ * unrecorded.
+ *
+ * Frees are numbered before the block is released and allocations after
+ * the block is obtained, so a block's allocation always precedes its
+ * free, which precedes any reuse of its address. At exit the buffers of
+ * threads that are still running are written as they are.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "recorder.h"
+
+#define REC_BUF 4096          /* records per buffer */
+#define BOOT_BYTES (1 << 16)  /* arena for calls made while resolving libc */
+
+/* A buffer of records, owned by one thread until it is queued */
+typedef struct recbuf {
+    rec_t recs[REC_BUF];
+    int n;                    /* records used */
+    int active;               /* still some thread's current buffer */
+    struct recbuf *next;      /* next on the write queue or free list */
+    struct recbuf *all_next;  /* next of all buffers ever made */
+} recbuf_t;
+
+/* The real allocator */
+static void *(*real_malloc)(size_t);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+static void (*real_free)(void *);
+static void *(*real_memalign)(size_t, size_t);
+static int (*real_posix_memalign)(void **, size_t, size_t);
+static void *(*real_aligned_alloc)(size_t, size_t);
+
+/* Bootstrap arena for dlsym's own allocations */
+static char boot[BOOT_BYTES];
+static size_t boot_used;
+#define IS_BOOT(p) ((char *)(p) >= boot && (char *)(p) < boot + BOOT_BYTES)
+
+static int recording;         /* set between rec_init and rec_fini */
+static int fd = -1;           /* the log */
+static unsigned long long next_seq;
+static unsigned int next_thread;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER; /* guards below */
+static pthread_cond_t queued = PTHREAD_COND_INITIALIZER;
+static recbuf_t *queue_head, *queue_tail;  /* full buffers to write */
+static recbuf_t *free_bufs;                /* written buffers to reuse */
+static recbuf_t *all_bufs;                 /* every buffer, for rec_fini */
+static int writer_done;                    /* rec_fini asks writer to stop */
+static pthread_t writer;
+static int writer_started;
+static pthread_key_t thread_key;           /* flushes at thread exit */
+
+static __thread recbuf_t *cur;             /* this thread's buffer */
+static __thread unsigned int thread_id;
+static __thread int busy;                  /* inside a hook: don't record */
+
+/*
+ * write_all - Write n bytes to the log, retrying short writes
+ */
+static void write_all(void *buf, size_t n)
+{
+    ssize_t w;
+
+    while (n > 0 && (w = write(fd, buf, n)) > 0) {
+        buf = (char *)buf + w;
+        n -= w;
+    }
+}
+
+/*
+ * writer_main - Body of the writer thread: write queued buffers to
+ *     the log until rec_fini says stop and the queue is empty
+ */
+static void *writer_main(void *arg)
+{
+    recbuf_t *b;
+
+    busy = 1;  /* nothing this thread does is the program's */
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        while (queue_head == NULL && !writer_done)
+            pthread_cond_wait(&queued, &lock);
+        if ((b = queue_head) == NULL)
+            break;
+        if ((queue_head = b->next) == NULL)
+            queue_tail = NULL;
+        pthread_mutex_unlock(&lock);
+
+        write_all(b->recs, b->n * sizeof(rec_t));
+
+        pthread_mutex_lock(&lock);
+        b->n = 0;
+        b->next = free_bufs;
+        free_bufs = b;
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+/*
+ * enqueue - Hand the calling thread's buffer to the writer thread
+ */
+static void enqueue(void)
+{
+    recbuf_t *b = cur;
+
+    cur = NULL;
+    if (b == NULL)
+        return;
+    pthread_mutex_lock(&lock);
+    b->active = 0;
+    b->next = NULL;
+    if (queue_tail)
+        queue_tail->next = b;
+    else
+        queue_head = b;
+    queue_tail = b;
+    if (!writer_started && pthread_create(&writer, NULL, writer_main, NULL) == 0)
+        writer_started = 1;
+    pthread_cond_signal(&queued);
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * thread_exit - Key destructor: queue the exiting thread's last records
+ */
+static void thread_exit(void *arg)
+{
+    busy = 1;
+    enqueue();
+}
+
+/*
+ * new_seq - Take the next number of the global call order
+ */
+static unsigned long long new_seq(void)
+{
+    return __atomic_fetch_add(&next_seq, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * record - Append one record, with call order seq, to the calling
+ *     thread's buffer
+ */
+static void record(unsigned long long seq, unsigned int type, void *ptr,
+                   void *old, size_t size, size_t aux)
+{
+    rec_t *r;
+
+    if (cur == NULL) {
+        pthread_mutex_lock(&lock);
+        if ((cur = free_bufs) != NULL)
+            free_bufs = cur->next;
+        pthread_mutex_unlock(&lock);
+        if (cur == NULL) {
+            cur = mmap(NULL, sizeof(recbuf_t), PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (cur == MAP_FAILED) {
+                cur = NULL;
+                return;  /* drop the record rather than fail the program */
+            }
+            pthread_mutex_lock(&lock);
+            cur->all_next = all_bufs;
+            all_bufs = cur;
+            pthread_mutex_unlock(&lock);
+        }
+        cur->n = 0;
+        cur->active = 1;
+        if (thread_id == 0) {
+            thread_id = __atomic_add_fetch(&next_thread, 1, __ATOMIC_RELAXED);
+            pthread_setspecific(thread_key, (void *)1);
+        }
+    }
+
+    r = &cur->recs[cur->n];
+    r->seq = seq;
+    r->ptr = (unsigned long)ptr;
+    r->old = (unsigned long)old;
+    r->size = size;
+    r->aux = aux;
+    r->type = type;
+    r->thread = thread_id - 1;
+    if (++cur->n == REC_BUF)
+        enqueue();
+}
+
+/*
+ * resolve - Look up the real allocator. dlsym may allocate; those
+ *     calls are served from the bootstrap arena.
+ */
+static void resolve(void)
+{
+    busy = 1;
+    real_malloc = dlsym(RTLD_NEXT, "malloc");
+    real_calloc = dlsym(RTLD_NEXT, "calloc");
+    real_realloc = dlsym(RTLD_NEXT, "realloc");
+    real_free = dlsym(RTLD_NEXT, "free");
+    real_memalign = dlsym(RTLD_NEXT, "memalign");
+    real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+    real_aligned_alloc = dlsym(RTLD_NEXT, "aligned_alloc");
+    busy = 0;
+}
+
+static void *boot_alloc(size_t size)
+{
+    void *p;
+
+    size = (size + 15) & ~(size_t)15;
+    if (boot_used + size > BOOT_BYTES)
+        return NULL;
+    p = boot + boot_used;
+    boot_used += size;
+    return p;   /* static storage, already zeroed */
+}
+
+void *malloc(size_t size)
+{
+    void *p;
+
+    if (real_malloc == NULL) {
+        if (busy)
+            return boot_alloc(size);
+        resolve();
+    }
+    p = real_malloc(size);
+    if (recording && !busy) {
+        busy = 1;
+        record(new_seq(), REC_MALLOC, p, NULL, size, 0);
+        busy = 0;
+    }
+    return p;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p;
+
+    if (real_calloc == NULL) {
+        if (busy)
+            return boot_alloc(nmemb * size);
+        resolve();
+    }
+    p = real_calloc(nmemb, size);
+    if (recording && !busy) {
+        busy = 1;
+        record(new_seq(), REC_CALLOC, p, NULL, size, nmemb);
+        busy = 0;
+    }
+    return p;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    void *p;
+    unsigned long long seq = 0;
+    int rec;
+
+    if (real_realloc == NULL) {
+        if (busy) {  /* only bootstrap blocks exist yet */
+            if ((p = boot_alloc(size)) != NULL && ptr != NULL)
+                memmove(p, ptr, size);  /* ptr < p, so this stays in boot */
+            return p;
+        }
+        resolve();
+    }
+    if (IS_BOOT(ptr)) {  /* move a bootstrap block to the real heap */
+        size_t avail = boot + BOOT_BYTES - (char *)ptr;
+
+        if ((p = real_malloc(size)) != NULL)
+            memcpy(p, ptr, (size < avail) ? size : avail);
+        return p;
+    }
+    /* Order the resize before any call that gets ptr back once it has
+       been freed; a realloc of NULL is an allocation, ordered after */
+    rec = recording && !busy;
+    if (rec && ptr != NULL)
+        seq = new_seq();
+    p = real_realloc(ptr, size);
+    if (rec) {
+        busy = 1;
+        if (ptr == NULL)
+            record(new_seq(), REC_REALLOC, p, NULL, size, 0);
+        else {
+            record(seq, REC_REALLOC, p, ptr, size, 0);
+            if (p != NULL)
+                record(new_seq(), REC_REALLOC_DONE, p, NULL, size, 0);
+        }
+        busy = 0;
+    }
+    return p;
+}
+
+void free(void *ptr)
+{
+    if (ptr == NULL || IS_BOOT(ptr))
+        return;
+    if (real_free == NULL)
+        resolve();
+    if (recording && !busy) {
+        busy = 1;
+        record(new_seq(), REC_FREE, ptr, NULL, 0, 0);
+        busy = 0;
+    }
+    real_free(ptr);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    void *p;
+
+    if (real_memalign == NULL)
+        resolve();
+    p = real_memalign(alignment, size);
+    if (recording && !busy) {
+        busy = 1;
+        record(new_seq(), REC_MEMALIGN, p, NULL, size, alignment);
+        busy = 0;
+    }
+    return p;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    int err;
+
+    if (real_posix_memalign == NULL)
+        resolve();
+    err = real_posix_memalign(memptr, alignment, size);
+    if (recording && !busy && err == 0) {
+        busy = 1;
+        record(new_seq(), REC_MEMALIGN, *memptr, NULL, size, alignment);
+        busy = 0;
+    }
+    return err;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    void *p;
+
+    if (real_aligned_alloc == NULL)
+        resolve();
+    p = real_aligned_alloc(alignment, size);
+    if (recording && !busy) {
+        busy = 1;
+        record(new_seq(), REC_MEMALIGN, p, NULL, size, alignment);
+        busy = 0;
+    }
+    return p;
+}
+
+/*
+ * rec_child - In a forked child only the forking thread survives, and
+ *     not the writer, so the child does not record
+ */
+static void rec_child(void)
+{
+    recording = 0;
+}
+
+/*
+ * rec_init - Open the log named by $MMREC_FILE, with %p replaced by the
+ *     pid so that exec'd children get logs of their own (default
+ *     mmrec.<pid>.rec), and start recording
+ */
+__attribute__((constructor))
+static void rec_init(void)
+{
+    char path[256];
+    char *name = getenv("MMREC_FILE"), *pct;
+    rechdr_t hdr;
+
+    if (real_malloc == NULL)
+        resolve();
+    if (name == NULL)
+        snprintf(path, sizeof(path), "mmrec.%d.rec", (int)getpid());
+    else if ((pct = strstr(name, "%p")) != NULL)
+        snprintf(path, sizeof(path), "%.*s%d%s", (int)(pct - name), name,
+                 (int)getpid(), pct + 2);
+    else
+        snprintf(path, sizeof(path), "%s", name);
+    name = path;
+    if ((fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        return;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, REC_MAGIC, sizeof(hdr.magic));
+    hdr.rec_size = sizeof(rec_t);
+    hdr.pid = getpid();
+    write_all(&hdr, sizeof(hdr));
+
+    pthread_key_create(&thread_key, thread_exit);
+    pthread_atfork(NULL, NULL, rec_child);
+    recording = 1;
+}
+
+/*
+ * rec_fini - Stop recording, let the writer drain the queue, and write
+ *     the buffers of the threads that have not exited
+ */
+__attribute__((destructor))
+static void rec_fini(void)
+{
+    recbuf_t *b;
+
+    if (!recording)
+        return;
+    recording = 0;
+    busy = 1;
+    enqueue();
+
+    pthread_mutex_lock(&lock);
+    writer_done = 1;
+    pthread_cond_signal(&queued);
+    pthread_mutex_unlock(&lock);
+    if (writer_started)
+        pthread_join(writer, NULL);
+
+    for (b = all_bufs; b != NULL; b = b->all_next)
+        if (b->active && b->n > 0)
+            write_all(b->recs, b->n * sizeof(rec_t));
+    close(fd);
+}
@@ -0,0 +1,45 @@
+/*
+ * recorder.h - Format of the allocation logs written by librecorder.so
+ *
+ * A log is a rechdr_t followed by rec_t records, one per intercepted
+ * malloc, calloc, realloc, free, memalign, posix_memalign or
+ * aligned_alloc, in host byte order. Records are
+ * written in per-thread batches, so they are not in call order in the
+ * file; their seq numbers give the order. rec2trace turns a log into a
+ * mdriver trace.
+ *
+ * A realloc of a block is logged twice. Its REC_REALLOC record takes
+ * its seq before the call, while the old block is still the caller's,
+ * so it sorts before any call that gets the old address back; a
+ * REC_REALLOC_DONE record with a seq taken after the call marks when
+ * the block it returned became the caller's.
+ */
+#ifndef __RECORDER_H_
+#define __RECORDER_H_
+
+#define REC_MAGIC "MMREC03"   /* first 8 bytes of a log (02 logged a realloc
+                                 once, 01 had no aux) */
+
+/* Record types */
+enum {REC_MALLOC, REC_FREE, REC_REALLOC, REC_CALLOC, REC_MEMALIGN,
+      REC_REALLOC_DONE};
+
+/* Header of a log */
+typedef struct {
+    char magic[8];             /* REC_MAGIC, NUL terminated */
+    unsigned int rec_size;     /* sizeof(rec_t) */
+    unsigned int pid;          /* recorded process */
+} rechdr_t;
+
+/* One intercepted call */
+typedef struct {
+    unsigned long long seq;    /* global call order */
+    unsigned long long ptr;    /* block returned (malloc, realloc) or freed */
+    unsigned long long old;    /* block passed to realloc */
+    unsigned long long size;   /* bytes requested (calloc: of each element) */
+    unsigned long long aux;    /* calloc: nmemb; memalign: alignment; else 0 */
+    unsigned int type;         /* REC_MALLOC, REC_FREE, ... */
+    unsigned int thread;       /* recording thread, numbered from 0 */
+} rec_t;
+
+#endif /* __RECORDER_H_ */
@@ -0,0 +1,141 @@
+/*
+ * rep2bin.c - Convert a .rep tracefile to the binary trace format
+ *
+ * Writes the tracehdr_t and packed traceop_t records described in
+ * trace.h, which mdriver maps and replays without parsing. The .rep is
+ * read one request at a time, so traces far larger than memory convert
+ * fine. The output defaults to the input name with .rep replaced by
+ * .bin.
+ *
+ * Usage: rep2bin [-o <file>] <trace>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "trace.h"
+
+#define MAXLINE 1024
+
+static void usage(void);
+
+/*
+ * bad_trace - Report a malformed .rep and quit
+ */
+static void bad_trace(char *path, unsigned op, char *what)
+{
+    fprintf(stderr, "%s: %s at request %u\n", path, what, op);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int c;
+    char *inpath, *outfile = NULL;
+    char outpath[MAXLINE], line[MAXLINE];
+    FILE *in, *out;
+    tracehdr_t hdr;
+    traceop_t op;
+    unsigned num_ops;
+    int parsed;
+
+    while ((c = getopt(argc, argv, "o:h")) != EOF) {
+        switch (c) {
+        case 'o':
+            outfile = optarg;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+        exit(1);
+    }
+    inpath = argv[optind];
+    if (outfile == NULL) {
+        size_t len = strlen(inpath);
+
+        if (len >= 4 && strcmp(inpath + len - 4, ".rep") == 0)
+            len -= 4;
+        if (len + 5 > MAXLINE) {
+            fprintf(stderr, "Path too long: %s\n", inpath);
+            exit(1);
+        }
+        memcpy(outpath, inpath, len);
+        strcpy(outpath + len, ".bin");
+        outfile = outpath;
+    }
+
+    if ((in = fopen(inpath, "r")) == NULL) {
+        fprintf(stderr, "Could not open %s\n", inpath);
+        exit(1);
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    if (fscanf(in, "%d %d %d %d", &hdr.sugg_heapsize, &hdr.num_ids,
+               &hdr.num_ops, &hdr.weight) != 4 ||
+        hdr.num_ids < 0 || hdr.num_ops < 0 ||
+        (unsigned)hdr.num_ids > TRACE_MAX_INDEX + 1) {
+        fprintf(stderr, "Bad trace header in %s\n", inpath);
+        exit(1);
+    }
+    memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.version = TRACE_VERSION;
+    hdr.op_size = sizeof(traceop_t);
+
+    if ((out = fopen(outfile, "wb")) == NULL) {
+        fprintf(stderr, "Could not open %s\n", outfile);
+        exit(1);
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, out) != 1) {
+        fprintf(stderr, "Could not write %s\n", outfile);
+        exit(1);
+    }
+
+    /* Convert one request at a time */
+    num_ops = 0;
+    memset(&op, 0, sizeof(op));
+    while (fgets(line, MAXLINE, in) != NULL) {
+        if ((parsed = trace_parse_op(line, &op)) == 0)
+            continue;
+        if (parsed < 0)
+            bad_trace(inpath, num_ops, "Bad request");
+        if (!trace_op_ok(&op, hdr.num_ids))
+            bad_trace(inpath, num_ops, "Id, count or alignment out of range");
+        if (fwrite(&op, sizeof(op), 1, out) != 1) {
+            fprintf(stderr, "Could not write %s\n", outfile);
+            exit(1);
+        }
+        num_ops++;
+    }
+    fclose(in);
+    if (fclose(out) != 0) {
+        fprintf(stderr, "Could not write %s\n", outfile);
+        exit(1);
+    }
+
+    if (num_ops != (unsigned)hdr.num_ops) {
+        fprintf(stderr, "%s: header says %d ops, found %u\n",
+                inpath, hdr.num_ops, num_ops);
+        remove(outfile);
+        exit(1);
+    }
+    fprintf(stderr, "%s: %u ops, %d ids\n", outfile, num_ops, hdr.num_ids);
+    return 0;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: rep2bin [-h] [-o <file>] <trace>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-o <file>  Write the binary trace to <file> (default <trace>.bin).\n");
+}
@@ -0,0 +1,71 @@
+/*
+ * sizeclass.h - Size classes of mm.c, generated by gen_sizeclass from
+ *     traces/amptjp-bal.rep
+ *     traces/amptjp.rep
+ *     traces/binary-bal.rep
+ *     traces/binary.rep
+ *     traces/binary2-bal.rep
+ *     traces/binary2.rep
+ *     traces/cccp-bal.rep
+ *     traces/cccp.rep
+ *     traces/coalescing-bal.rep
+ *     traces/coalescing.rep
+ *     traces/cp-decl-bal.rep
+ *     traces/cp-decl.rep
+ *     traces/expr-bal.rep
+ *     traces/expr.rep
+ *     traces/random-bal.rep
+ *     traces/random.rep
+ *     traces/random2-bal.rep
+ *     traces/random2.rep
+ *     traces/realloc-bal.rep
+ *     traces/realloc.rep
+ *     traces/realloc2-bal.rep
+ *     traces/realloc2.rep
+ *     traces/short1-bal.rep
+ *     traces/short1.rep
+ *     traces/short2-bal.rep
+ *     traces/short2.rep
+ *
+ * Do not edit; run "make sizeclasses" to regenerate.
+ */
+#ifndef __SIZECLASS_H_
+#define __SIZECLASS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NUM_SIZE_CLASSES 16
+#define SIZE_CLASS_LOOKUP_MAX 4096
+
+/* Largest block size (bytes, incl. header and footer) of each class */
+static const size_t size_class_bounds[NUM_SIZE_CLASSES] = {
+    32, 80, 96, 128, 144, 176, 464, 528,
+    1136, 1680, 2240, 2784, 3280, 3648, 4096, SIZE_MAX
+};
+
+/* Class of every block size up to SIZE_CLASS_LOOKUP_MAX, indexed by size / 16 */
+static const unsigned char size_class_lookup[SIZE_CLASS_LOOKUP_MAX / 16 + 1] = {
+    0, 0, 0, 1, 1, 1, 2, 3, 3, 4, 5, 5, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 7, 7,
+    7, 7, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+    8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+    8, 8, 8, 8, 8, 8, 8, 8, 9, 9, 9, 9, 9, 9, 9, 9,
+    9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9,
+    9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 10, 10, 10, 10, 10, 10,
+    10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10,
+    10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 11, 11, 11,
+    11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+    11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 12,
+    12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+    12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 13, 13,
+    13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13,
+    13, 13, 13, 13, 13, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+    14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+    14
+};
+
+#define SIZE_CLASS(size) ((size) <= SIZE_CLASS_LOOKUP_MAX ? \
+    size_class_lookup[(size) / 16] : NUM_SIZE_CLASSES - 1)
+
+#endif /* __SIZECLASS_H_ */
@@ -0,0 +1,202 @@
+/*
+ * stream.c - Read a tracefile in bounded chunks on a reader thread
+ *
+ * stream_open reads the trace header and starts a reader thread that
+ * parses (for a .rep) or reads (for a binary trace) the ops into two
+ * buffers in turn. stream_next returns the next full buffer to the
+ * caller and hands the previous one back to the reader, so the reader
+ * is always at most one chunk ahead of the replay.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "stream.h"
+
+#define MAXLINE 1024
+
+/* 
+ * stream_error - Report an error in the tracefile and quit
+ */
+static void stream_error(trace_stream_t *s, char *msg, long op)
+{
+    printf("%s in tracefile %s at request %ld\n", msg, s->path, op);
+    exit(1);
+}
+
+/*
+ * fill_rep - Parse up to STREAM_CHUNK .rep request lines into ops[],
+ *     returning how many were read. op is the number of requests
+ *     parsed before this chunk.
+ */
+static int fill_rep(trace_stream_t *s, traceop_t *ops, long op)
+{
+    char line[MAXLINE];
+    int n, parsed;
+
+    for (n = 0; n < STREAM_CHUNK; ) {
+	if (fgets(line, MAXLINE, s->fp) == NULL)
+	    break;
+	if ((parsed = trace_parse_op(line, &ops[n])) == 0)
+	    continue;
+	if (parsed < 0)
+	    stream_error(s, "Malformed request", op + n);
+	if (!trace_op_ok(&ops[n], s->num_ids))
+	    stream_error(s, "Id, count or alignment out of range", op + n);
+	n++;
+    }
+    return n;
+}
+
+/*
+ * fill_bin - Read up to STREAM_CHUNK binary records into ops[]
+ */
+static int fill_bin(trace_stream_t *s, traceop_t *ops, long op)
+{
+    int i, n;
+
+    n = fread(ops, sizeof(traceop_t), STREAM_CHUNK, s->fp);
+    for (i = 0; i < n; i++)
+	if (!trace_op_ok(&ops[i], s->num_ids))
+	    stream_error(s, "Bogus op", op + i);
+    return n;
+}
+
+/*
+ * reader - Body of the reader thread: fill the buffers in turn until 
+ *     the tracefile ends, then post an empty buffer
+ */
+static void *reader(void *arg)
+{
+    trace_stream_t *s = (trace_stream_t *)arg;
+    long op = 0;
+    int b = 0, n;
+
+    do {
+	/* Wait for the caller to hand buffer b back */
+	pthread_mutex_lock(&s->lock);
+	while (s->full[b])
+	    pthread_cond_wait(&s->cond, &s->lock);
+	pthread_mutex_unlock(&s->lock);
+
+	n = s->binary ? fill_bin(s, s->buf[b], op) : fill_rep(s, s->buf[b], op);
+	op += n;
+
+	pthread_mutex_lock(&s->lock);
+	s->len[b] = n;
+	s->full[b] = 1;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	b ^= 1;
+    } while (n > 0);
+
+    if (op != s->num_ops) {
+	printf("Tracefile %s has %ld requests, header says %d\n", 
+	       s->path, op, s->num_ops);
+	exit(1);
+    }
+    return NULL;
+}
+
+/*
+ * stream_open - Open the tracefile at path, read its header and start
+ *     the reader thread
+ */
+trace_stream_t *stream_open(char *path)
+{
+    trace_stream_t *s;
+    tracehdr_t hdr;
+    int i;
+
+    if ((s = (trace_stream_t *)calloc(1, sizeof(trace_stream_t))) == NULL) {
+	printf("calloc failed in stream_open: %s\n", strerror(errno));
+	exit(1);
+    }
+    if ((s->fp = fopen(path, "r")) == NULL) {
+	printf("Could not open %s in stream_open: %s\n", path, strerror(errno));
+	exit(1);
+    }
+    s->path = path;
+
+    /* Binary traces start with a tracehdr_t, .rep with four numbers */
+    if (fread(&hdr, sizeof(hdr), 1, s->fp) == 1 &&
+	memcmp(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic)) == 0) {
+	if (hdr.version != TRACE_VERSION || hdr.op_size != sizeof(traceop_t)) {
+	    printf("Binary trace %s has version %u and %u-byte ops\n",
+		   path, hdr.version, hdr.op_size);
+	    exit(1);
+	}
+	s->binary = 1;
+	s->sugg_heapsize = hdr.sugg_heapsize;
+	s->num_ids = hdr.num_ids;
+	s->num_ops = hdr.num_ops;
+	s->weight = hdr.weight;
+    }
+    else {
+	rewind(s->fp);
+	if (fscanf(s->fp, "%d %d %d %d", &s->sugg_heapsize, &s->num_ids,
+		   &s->num_ops, &s->weight) != 4) {
+	    printf("Bad trace header in %s\n", path);
+	    exit(1);
+	}
+    }
+
+    for (i = 0; i < 2; i++)
+	if ((s->buf[i] = 
+	     (traceop_t *)malloc(STREAM_CHUNK * sizeof(traceop_t))) == NULL) {
+	    printf("malloc failed in stream_open: %s\n", strerror(errno));
+	    exit(1);
+	}
+    s->held = -1;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    if (pthread_create(&s->reader, NULL, reader, s) != 0) {
+	printf("pthread_create failed in stream_open\n");
+	exit(1);
+    }
+    return s;
+}
+
+/*
+ * stream_next - Point *ops at the next chunk of requests and return 
+ *     how many it holds, or 0 at the end of the trace. The chunk stays
+ *     valid until the next call.
+ */
+int stream_next(trace_stream_t *s, traceop_t **ops)
+{
+    int b = s->next, n;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->held >= 0) {          /* hand the previous chunk back */
+	s->full[s->held] = 0;
+	pthread_cond_broadcast(&s->cond);
+	s->held = -1;
+    }
+    while (!s->full[b])
+	pthread_cond_wait(&s->cond, &s->lock);
+    n = s->len[b];
+    pthread_mutex_unlock(&s->lock);
+
+    if (n > 0) {
+	s->held = b;
+	s->next = b ^ 1;
+    }
+    *ops = s->buf[b];
+    return n;
+}
+
+/*
+ * stream_close - Wait for the reader thread and release the stream.
+ *     The caller must have read the stream to its end.
+ */
+void stream_close(trace_stream_t *s)
+{
+    pthread_join(s->reader, NULL);
+    fclose(s->fp);
+    free(s->buf[0]);
+    free(s->buf[1]);
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond);
+    free(s);
+}
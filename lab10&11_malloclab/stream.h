@@ -0,0 +1,39 @@
+/*
+ * stream.h - Read a tracefile in bounded chunks on a reader thread
+ *
+ * A trace stream hands out the ops of a .rep or binary tracefile
+ * STREAM_CHUNK at a time. A reader thread fills one of two buffers
+ * while the caller replays the other, so parsing overlaps the replay
+ * and memory use does not grow with the length of the trace.
+ */
+#include <stdio.h>
+#include <pthread.h>
+
+#include "trace.h"
+
+#define STREAM_CHUNK (1 << 16)   /* ops per buffer */
+
+typedef struct {
+    /* The trace header, valid once stream_open returns */
+    int sugg_heapsize;           /* suggested heap size (unused) */
+    int num_ids;                 /* number of alloc/realloc ids */
+    int num_ops;                 /* number of requests */
+    int weight;                  /* weight for this trace (unused) */
+
+    /* Private to stream.c */
+    FILE *fp;                    /* the open tracefile */
+    char *path;                  /* its name, for error messages */
+    int binary;                  /* binary format, else .rep */
+    traceop_t *buf[2];           /* the two chunk buffers... */
+    int len[2];                  /* ... the ops in each, 0 at the end... */
+    int full[2];                 /* ... and whether each awaits replay */
+    int next;                    /* buffer the caller gets next */
+    int held;                    /* buffer the caller holds, or -1 */
+    pthread_t reader;
+    pthread_mutex_t lock;        /* protects len[] and full[] */
+    pthread_cond_t cond;         /* signalled when full[] changes */
+} trace_stream_t;
+
+trace_stream_t *stream_open(char *path);
+int stream_next(trace_stream_t *stream, traceop_t **ops);
+void stream_close(trace_stream_t *stream);
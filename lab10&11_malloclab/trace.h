@@ -0,0 +1,133 @@
+#ifndef __TRACE_H_
+#define __TRACE_H_
+
+#include <stdlib.h>
+
+/*
+ * trace.h - Trace operations and the binary trace format
+ *
+ * A .rep tracefile is text: four header numbers followed by one line
+ * per request:
+ *
+ *   a <id> <size>              malloc
+ *   r <id> <size>              realloc
+ *   f <id>                     free
+ *   c <id> <nmemb> <size>      calloc
+ *   m <id> <alignment> <size>  memalign (a power of two)
+ *   s <id> <size>              sized free (the size it was allocated with)
+ *   A <id> <count> <size>      batch malloc of ids <id> .. <id>+<count>-1
+ *   F <id> <count>             batch free of ids <id> .. <id>+<count>-1
+ *
+ * A binary tracefile (made from a .rep by rep2bin) holds the same
+ * information as a tracehdr_t followed directly by num_ops packed
+ * traceop_t records, so mdriver can mmap it and replay the records in
+ * place without parsing. Binary traces are in host byte order; the
+ * header's version and op_size fields reject files written with a
+ * different layout.
+ */
+
+/* Request types of a traceop_t */
+enum {ALLOC, FREE, REALLOC, CALLOC, MEMALIGN, SIZED_FREE, BATCH_ALLOC, 
+      BATCH_FREE, NUM_OP_TYPES};
+
+#define TRACE_LETTERS "afrcmsAF"  /* .rep letter of each request type */
+#define TRACE_MAX_INDEX ((1u << 28) - 1) /* largest id a traceop_t holds */
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct {
+    unsigned int type : 4;    /* ALLOC, FREE, ... */
+    unsigned int index : 28;  /* index for free() to use later */
+    unsigned int aux;         /* nmemb of calloc, alignment of memalign,
+                                 count of batch; else 0 */
+    unsigned long long size;  /* byte size of request (of each element of
+                                 a calloc, of each block of a batch) */
+} traceop_t;
+
+/* Payload bytes of the block (each block, for a batch) that op allocates */
+#define OP_PAYLOAD(op) ((op)->type == CALLOC ? (op)->aux * (op)->size : \
+                        (op)->size)
+
+/* Number of ids an op covers, from its index */
+#define OP_IDS(op) (((op)->type == BATCH_ALLOC || (op)->type == BATCH_FREE) ? \
+                    (op)->aux : 1)
+
+#define TRACE_MAGIC "MMTRACE"  /* first 8 bytes of a binary trace */
+#define TRACE_VERSION 3        /* 2 had 32-bit sizes, 1 had no aux field
+                                  and only a, r, f */
+
+/* Header of a binary tracefile; the traceop_t records follow it */
+typedef struct {
+    char magic[8];             /* TRACE_MAGIC, NUL terminated */
+    unsigned int version;      /* TRACE_VERSION */
+    unsigned int op_size;      /* sizeof(traceop_t) */
+    int sugg_heapsize;         /* suggested heap size (unused) */
+    int num_ids;               /* number of alloc/realloc ids */
+    int num_ops;               /* number of records that follow */
+    int weight;                /* weight for this trace (unused) */
+} tracehdr_t;
+
+/*
+ * trace_parse_op - Parse one .rep request line into *op. Returns 1 if
+ *     the line holds a request, 0 if it is blank and -1 if it is
+ *     malformed. The ids are not checked; see trace_op_ok.
+ */
+static inline int trace_parse_op(char *line, traceop_t *op)
+{
+    static const char letters[] = TRACE_LETTERS;
+    static const int fields[NUM_OP_TYPES] = {2, 1, 2, 3, 3, 2, 3, 2};
+    unsigned long long v[3] = {0, 0, 0};
+    char *p = line, *end;
+    int type, i;
+
+    while (*p == ' ' || *p == '\t')
+        p++;
+    if (*p == '\n' || *p == '\r' || *p == '\0')
+        return 0;
+    for (type = 0; type < NUM_OP_TYPES && letters[type] != *p; type++)
+        ;
+    if (type == NUM_OP_TYPES)
+        return -1;
+    /* Every field but a size (the last one of a, r, s, c, m, A) fits
+     * 32 bits */
+    for (p++, i = 0; i < fields[type]; i++, p = end) {
+        v[i] = strtoull(p, &end, 10);
+        if (end == p || (v[i] > 0xffffffffULL &&
+                         (i < fields[type] - 1 || type == BATCH_FREE)))
+            return -1;
+    }
+    op->type = type;
+    op->index = v[0];
+    op->size = op->aux = 0;
+    if (fields[type] == 3) {        /* c, m, A: aux, then size */
+        op->aux = v[1];
+        op->size = v[2];
+    }
+    else if (type == BATCH_FREE)    /* F: count */
+        op->aux = v[1];
+    else if (fields[type] == 2)     /* a, r, s: size */
+        op->size = v[1];
+    return (v[0] > TRACE_MAX_INDEX) ? -1 : 1;
+}
+
+/*
+ * trace_op_ok - Is op well formed, with all its ids below num_ids?
+ */
+static inline int trace_op_ok(traceop_t *op, unsigned int num_ids)
+{
+    if (op->type >= NUM_OP_TYPES || op->index >= num_ids ||
+        op->size > (size_t)-1)
+        return 0;
+    switch (op->type) {
+    case CALLOC:    /* the payload must fit a size_t too */
+        return op->size == 0 || op->aux <= (size_t)-1 / op->size;
+    case MEMALIGN:  /* a power of two */
+        return op->aux != 0 && (op->aux & (op->aux - 1)) == 0;
+    case BATCH_ALLOC:
+    case BATCH_FREE:
+        return op->aux != 0 && op->aux <= num_ids - op->index;
+    default:
+        return op->aux == 0;
+    }
+}
+
+#endif /* __TRACE_H_ */